@@ -13,29 +13,92 @@
 #include <net/tcp_states.h>
 #include <linux/list.h>
 #include <linux/time64.h>
-
+#include <linux/version.h>
+#include <linux/sysctl.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#include <linux/hashtable.h>
+#include <linux/jhash.h>
+#include <linux/spinlock.h>
+#include <linux/hrtimer.h>
+#include <linux/win_minmax.h>
+#include <linux/list_sort.h>
+
+// the module parameters below seed the profiles of each new network namespace, see struct params. writing one at
+// run time also sets it in the default profile of the initial namespace
+static int profile_param_set(const char *val, const struct kernel_param *kp);
+static const struct kernel_param_ops profile_param_ops = {
+	.set = profile_param_set,
+	.get = param_get_int,
+};
 // the minimum number of data points needed to make a trend estimate
 static int sigma __read_mostly = 3;
-module_param(sigma, int, 0644);
+module_param_cb(sigma, &profile_param_ops, &sigma, 0644);
 // the increase factor alpha
 static int alpha __read_mostly = 100;
-module_param(alpha, int, 0644);
+module_param_cb(alpha, &profile_param_ops, &alpha, 0644);
 // the increase factor beta
 static int beta __read_mostly = 10;
-module_param(beta, int, 0644);
+module_param_cb(beta, &profile_param_ops, &beta, 0644);
 // the decrease factor magnified by 100 times
 static int gamma __read_mostly = 85;
-module_param(gamma, int, 0644);
+module_param_cb(gamma, &profile_param_ops, &gamma, 0644);
 // the minimum duration required to make a trend estimate, in ms
 static int tau __read_mostly = 60;
-module_param(tau, int, 0644);
+module_param_cb(tau, &profile_param_ops, &tau, 0644);
 // the slope threshold for congestion
 static int theta __read_mostly = 30;
-module_param(theta, int, 0644);
+module_param_cb(theta, &profile_param_ops, &theta, 0644);
 
 #define MAX_U32 0xffffffff
 #define MAX_RTT MAX_U32
 #define MIN_CWND 2U
+// the number of parameter profiles in each network namespace
+#define NR_PROFILES 4
+// the log2 of the number of buckets of the group hash table
+#define GROUP_HASH_BITS 8
+// the weight of a new slope in the shared trend estimate of a group is 1 / 2^GROUP_SLOPE_SHIFT
+#define GROUP_SLOPE_SHIFT 2
+// a curve position moving by more than this many periods of alpha or beta is recomputed instead of stepped
+#define CURVE_MAX_STEPS 8
+// the number of trend estimators, see struct estimator
+#define NR_ESTIMATORS 2
+// under memory pressure, the number of intervals rtt_sack is thinned to per tau and the maximum number of samples in rtt_bin
+#define PRESSURE_POINTS 16
+#define PRESSURE_SAMPLES 64
+// the number of closed rtt_bins the ACK path can hand to the deferred decision work, a power of 2
+#define DEFER_RING 32
+// the maximum batching interval of the deferred decision work, in us. rtt_bins close at most once per ms, so the ring does not fill up
+#define DEFER_MAX_US 10000
+// the verdict posted by the deferred decision work packs the generation it applies to above the decision
+#define DEFER_GEN_SHIFT 2
+// a loss is taken as non-congestive only while the RTT exceeds the base RTT by at most 1/2^LOSS_QUEUE_SHIFT of it
+#define LOSS_QUEUE_SHIFT 3
+// the last slope when no trend has been estimated since the last decrease
+#define NO_SLOPE ((s32)0x80000000)
+// the windows of the base RTT filter and of the recent RTT filter that detects a shift of the base RTT, in ms
+#define BASE_RTT_WIN_MS 300000
+#define RECENT_RTT_WIN_MS 1000
+/*
+ * the base RTT is taken again from the recent RTT filter once it stays above the base RTT by more than 1/2^BASE_RTT_DRIFT_SHIFT
+ * of it for BASE_RTT_DRIFT_MS and across BASE_RTT_DRIFT_DECS decreases that did not lower the RTT by 1/2^BASE_RTT_RESP_SHIFT
+ * a queue built by the flow itself shrinks with its cwnd, a longer path does not
+ */
+#define BASE_RTT_DRIFT_SHIFT 3
+#define BASE_RTT_DRIFT_MS 2000
+#define BASE_RTT_DRIFT_DECS 2
+#define BASE_RTT_RESP_SHIFT 4
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+#define flexis_register_sysctl(net, path, table, size) register_net_sysctl_sz(net, path, table, size)
+#else
+#define flexis_register_sysctl(net, path, table, size) register_net_sysctl(net, path, table)
+#endif
+
+// softirq hrtimers are available since 4.16, older kernels make every decision on the ACK path
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 16, 0)
+#define FLEXIS_DEFER
+#endif
 
 /*
  * returning the median of sorted values within the range of [start, end]
@@ -48,7 +111,7 @@ module_param(theta, int, 0644);
 #define median(head, start, end, type, member) ({ \
 		struct list_head *ptr, *head__ = (head); \
 		u32 start__ = (start), end__ = (end), pos = 0, pos_mid; \
-		type *ptr1, *ptr2; \
+		type *ptr1 = NULL, *ptr2 = NULL; \
 		typeof(((type *)0)->member) res; \
 		pos_mid = (start__ + end__) >> 1U; \
 		list_for_each(ptr, head__) { \
@@ -100,6 +163,13 @@ enum ret {
 	NO_MEM
 };
 
+// the outcome of adding a point to rtt_sack
+enum decision {
+	NO_DECISION,
+	NO_CONGESTION,
+	CONGESTION
+};
+
 // the struct for RTT samples
 struct rnode {
 	u32 rtt_us;
@@ -157,6 +227,153 @@ struct rtt_sack {
 	struct list_head head; 
 	u32 cnt;
 };
+/*
+ * a trend estimator over the points of rtt_sack
+ * @add: accounting for a point just added to the tail of rtt_sack. returning SUCCESS when a slope can be estimated
+ * @del: accounting for the oldest point of rtt_sack, which is removed right after
+ * @slope: estimating the slope (magnified 1000 times) of the points in rtt_sack
+ * @reset: forgetting all points while rtt_sack keeps them
+ */
+struct estimator {
+	int (*add)(struct sock *sk, struct pnode *pnode);
+	void (*del)(struct sock *sk, struct pnode *pnode);
+	int (*slope)(struct sock *sk, s32 *slope);
+	void (*reset)(struct sock *sk);
+};
+/*
+ * the state of the incremental least squares estimator. times are relative to the oldest point in rtt_sack
+ * @n: the number of points
+ * @t_base: the sending time of the oldest point, in ms
+ * @st: the sum of t, in ms
+ * @sd: the sum of d, in us
+ * @stt: the sum of t * t
+ * @std: the sum of t * d
+ */
+struct ols {
+	u32 n;
+	u64 t_base;
+	s64 st;
+	s64 sd;
+	s64 stt;
+	s64 std;
+};
+/*
+ * a position on the rate curve of an increase epoch, r(t) = (t / alpha)^3 + t / beta + r0 with t in ms since t0.
+ * the quotients are advanced by the elapsed time, so that evaluating the curve on every ACK needs no division
+ * @ms: the position t, in ms
+ * @qa: t / alpha
+ * @ra: t % alpha
+ * @qb: t / beta
+ * @rb: t % beta
+ */
+struct curve_pos {
+	u32 ms;
+	u32 qa;
+	u32 ra;
+	u32 qb;
+	u32 rb;
+};
+/*
+ * the rate curve engine of an increase epoch
+ * @now: the position of the current time
+ * @ahead: the position one RTT ahead of the current time
+ * @r1: the rate at "now" when the pacing ratio was last computed, in packets per second
+ * @r2: the rate at "ahead" when the pacing ratio was last computed
+ * @pr: the pacing ratio r2 / r1 in percent, rounded up
+ */
+struct curve {
+	struct curve_pos now;
+	struct curve_pos ahead;
+	u64 r1;
+	u64 r2;
+	u32 pr;
+};
+/*
+ * a parameter profile. a socket copies one profile into its vars at initialization
+ * @sigma: the minimum number of data points needed to make a trend estimate
+ * @alpha: the increase factor alpha
+ * @beta: the increase factor beta
+ * @gamma: the decrease factor magnified by 100 times
+ * @tau: the minimum duration required to make a trend estimate, in ms
+ * @theta: the slope threshold for congestion
+ * @estimator: the trend estimator, 0 for Theil-Sen and 1 for incremental least squares
+ * @defer_us: 0 to make congestion decisions on the ACK path, otherwise the interval in us within which a deferred 
+ * softirq context processes the closed rtt_bins in batches. the decision is applied on the next ACK
+ * @defer_batch: 1 to estimate the trend only at the last point of each deferred batch, which saves most of the work
+ * but makes fewer decisions than the ACK path. 0 to estimate at every point like the ACK path
+ * @loss_mode: 0 to halve cwnd on every loss, 1 to apply loss_gamma instead when the delay trend shows no queue build-up
+ * @loss_gamma: the decrease factor of a non-congestive loss magnified by 100 times
+ */
+struct params {
+	int sigma;
+	int alpha;
+	int beta;
+	int gamma;
+	int tau;
+	int theta;
+	int estimator;
+	int defer_us;
+	int loss_mode;
+	int loss_gamma;
+	int defer_batch;
+};
+/*
+ * a group of flows sharing a bottleneck, keyed by network namespace and destination address
+ * @node: the link in the group hash table
+ * @net: the network namespace of the members
+ * @daddr: the destination address of the members, an IPv4 address only uses daddr[0]
+ * @refcnt: the number of members, protected by groups_lock
+ * @lock: protecting the fields below
+ * @slope: the shared trend estimate, an EWMA of the Theil-Sen slopes reported by the members since the last decrease
+ * @slope_valid: whether a member has reported a slope since the last decrease
+ * @dec_seq: incremented by every group decrease. a member follows each increment with exactly one decrease
+ * @t0: the start time of the increase epoch shared by the members after the last decrease
+ */
+struct group {
+	struct hlist_node node;
+	struct net *net;
+	u32 daddr[4];
+	u32 refcnt;
+	spinlock_t lock;
+	s32 slope;
+	bool slope_valid;
+	u32 dec_seq;
+	u64 t0;
+};
+// a closed rtt_bin handed from the ACK path to the deferred decision work
+struct dpoint {
+	u64 snd_time_ms;
+	u32 rtt_us;
+	u32 gen;
+};
+/*
+ * the deferred decision work of a socket. the ACK path owns rtt_bin and produces into the ring, the work owns 
+ * rtt_sack, slopes and the estimator state and consumes the ring
+ * @ring: the closed rtt_bins not yet processed
+ * @head: the number of points produced, written by the ACK path only
+ * @tail: the number of points consumed, written by the work only
+ * @armed: whether the timer has been started for the points in the ring
+ * @gen: incremented by the ACK path whenever rtt_sack has to be reset, each point carries the gen it was produced in
+ * @sack_gen: the gen of the points in rtt_sack
+ * @keep_gen: a gen started by a non-congestive loss, whose points are added to the rtt_sack of the previous gen
+ * @verdict: the last decision of the work, with the gen it applies to
+ * @seen: the last verdict applied by the ACK path
+ * @timer: running the work in softirq context on the CPU that started it
+ * @sk: the socket
+ */
+struct defer {
+	struct dpoint ring[DEFER_RING];
+	u32 head;
+	u32 tail;
+	u32 armed;
+	u32 gen;
+	u32 sack_gen;
+	u32 keep_gen;
+	u32 verdict;
+	u32 seen;
+	struct hrtimer timer;
+	struct sock *sk;
+};
 /*
  * the rest of variables of the flexis struct
  * @t0: the start time of an increase epoch
@@ -166,7 +383,26 @@ struct rtt_sack {
  * pending is entered when the segment with the seqno equaling snd_nxt is acknowledged. 
  * @undo_cwnd: used by tcp to undo its wrong cwnd reduction
  * @rtt_us: the latest rtt sample in us
- * @epoch_min_rtt: the minimum RTT observed in the pending phase and the following increase phase
+ * @base_rtt: the windowed minimum RTT in us, the estimate of the propagation delay. it survives decreases
+ * @recent_rtt: the minimum RTT over a short window, used to detect a shift of the propagation delay
+ * @drift_ms: the time in ms since when recent_rtt has been well above base_rtt, 0 if it is not
+ * @drift_decs: the number of decreases since drift_ms that did not lower the RTT
+ * @dec_rtt: the RTT sample at the last decrease, in us
+ * @p: the parameters resolved from the profile selected for this socket
+ * @group: the group of flows sharing a bottleneck with this socket, NULL if not coupled
+ * @group_seq: the dec_seq of the group at the last decrease of this socket
+ * @mem: the bytes allocated for the rtt_bin, rtt_sack and slopes of this socket. atomic as the deferred decision work also allocates
+ * @pressure: whether this socket is under memory pressure
+ * @thin_ms: the minimum gap between points in rtt_sack, in ms. 0 when rtt_sack is not thinned
+ * @est: the trend estimator in use
+ * @ols: the state of the incremental least squares estimator
+ * @curve: the rate curve of the increase epoch
+ * @defer: the deferred decision work, NULL when decisions are made on the ACK path
+ * @last_slope: the last trend estimate since the last decrease, NO_SLOPE if none
+ * @mild_loss: whether the current loss recovery applies loss_gamma, so that it keeps rtt_sack
+ * @ece: whether the latest ACK echoed an ECN CE mark, which always calls for the full reduction
+ * @batch: the slopes generated by the deferred decision work since its last estimate, not sorted yet. they are counted
+ * in slopes.cnt
  */ 
 struct vars {
 	u64 t0; 
@@ -175,7 +411,25 @@ struct vars {
 	u32 snd_nxt; 
 	u32 undo_cwnd;  
 	s32 rtt_us; 
-	u32 epoch_min_rtt; 
+	struct minmax base_rtt;
+	struct minmax recent_rtt;
+	u32 drift_ms;
+	u32 drift_decs;
+	u32 dec_rtt;
+	struct params p;
+	struct group *group;
+	u32 group_seq;
+	atomic_t mem;
+	bool pressure;
+	u32 thin_ms;
+	const struct estimator *est;
+	struct ols ols;
+	struct curve curve;
+	struct defer *defer;
+	s32 last_slope;
+	bool mild_loss;
+	bool ece;
+	struct list_head batch;
 };
 /*
  * The flexis struct 
@@ -189,6 +443,113 @@ struct flexis {
 	struct slopes slopes; 
 	struct vars *vars; 
 };
+/*
+ * the per network namespace state, exported under /proc/sys/net/flexis
+ * @profile: the index of the profile used by sockets that do not select one
+ * @mark_mask: the bits of sk_mark that select a profile. a value v under the mask selects profile v - 1, 
+ * 0 selects the default profile. a mask of 0 disables the selection by sk_mark
+ * @coupled: whether flows to the same destination share a trend estimate and coordinate their decreases
+ * @profiles: the parameter profiles, each exported under /proc/sys/net/flexis/<name>
+ * @hdrs: the sysctl headers of the profile tables, the top level table and, in init_net, the memory table
+ */
+struct flexis_net {
+	int profile;
+	unsigned int mark_mask;
+	int coupled;
+	struct params profiles[NR_PROFILES];
+	struct ctl_table_header *hdrs[NR_PROFILES + 2];
+};
+
+static unsigned int flexis_net_id __read_mostly;
+// whether the flexis_net of init_net exists, so that module parameter writes can reach its default profile
+static bool profiles_ready;
+
+// the groups of coupled flows
+static DEFINE_HASHTABLE(groups, GROUP_HASH_BITS);
+static DEFINE_SPINLOCK(groups_lock);
+
+// the host wide cap on the bytes allocated by all sockets, 0 for no cap
+static unsigned long mem_max __read_mostly = 256UL << 20;
+// the cap on the bytes allocated by one socket, 0 for no cap
+static unsigned long sock_mem_max __read_mostly = 4UL << 20;
+// the bytes allocated by all sockets
+static atomic_long_t mem_bytes = ATOMIC_LONG_INIT(0);
+// the number of sockets under memory pressure
+static atomic_long_t mem_pressure = ATOMIC_LONG_INIT(0);
+// the number of allocations refused because of the caps
+static atomic_long_t mem_fails = ATOMIC_LONG_INIT(0);
+
+/////////////// memory operations ///////////////////
+
+// allocating zeroed memory charged to the socket, NULL if the allocation would exceed a cap
+static void *flexis_alloc(struct sock *sk, size_t size)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	unsigned long max = READ_ONCE(mem_max), sock_max = READ_ONCE(sock_mem_max);
+	void *ptr;
+
+	if ((max && atomic_long_read(&mem_bytes) + size > max) || (sock_max && atomic_read(&flexis->vars->mem) + size > sock_max)) {
+		atomic_long_inc(&mem_fails);
+		return NULL;
+	}
+
+	// allocation failures are handled by every caller, so the ACK path does not sleep or warn
+	ptr = kzalloc(size, GFP_ATOMIC | __GFP_NOWARN);
+	if (unlikely(!ptr)) {
+		return NULL;
+	}
+
+	atomic_long_add(size, &mem_bytes);
+	atomic_add(size, &flexis->vars->mem);
+
+	return ptr;
+}
+
+// freeing memory allocated by flexis_alloc
+static void flexis_free(struct sock *sk, void *ptr, size_t size)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+
+	if (!ptr) {
+		return;
+	}
+
+	kfree(ptr);
+	atomic_long_sub(size, &mem_bytes);
+	atomic_sub(size, &flexis->vars->mem);
+}
+
+// updating and returning the memory pressure state of the socket. pressure starts above 3/4 of either cap and ends below 1/2 of both
+static bool flexis_mem_pressure(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	unsigned long max = READ_ONCE(mem_max), sock_max = READ_ONCE(sock_mem_max);
+	unsigned long bytes = atomic_long_read(&mem_bytes);
+	bool pressure;
+
+	if (flexis->vars->pressure) {
+		pressure = (max && bytes > (max >> 1)) || (sock_max && atomic_read(&flexis->vars->mem) > (sock_max >> 1));
+	} else {
+		pressure = (max && bytes > max - (max >> 2)) || (sock_max && atomic_read(&flexis->vars->mem) > sock_max - (sock_max >> 2));
+	}
+
+	if (pressure != flexis->vars->pressure) {
+		flexis->vars->pressure = pressure;
+		if (pressure) {
+			atomic_long_inc(&mem_pressure);
+			// thinning rtt_sack harder every time the socket runs into pressure, up to one point per tau
+			if (flexis->vars->thin_ms) {
+				flexis->vars->thin_ms = min_t(u32, flexis->vars->thin_ms * 2, flexis->vars->p.tau);
+			} else {
+				flexis->vars->thin_ms = DIV_ROUND_UP(flexis->vars->p.tau, PRESSURE_POINTS);
+			}
+		} else {
+			atomic_long_dec(&mem_pressure);
+		}
+	}
+
+	return pressure;
+}
 
 /////////////// rtt_bin operations ///////////////////
 
@@ -198,11 +559,11 @@ static int rtt_bin_add_asd(struct sock *sk, u64 snd_time_ms, u32 rtt_us)
 	struct flexis *flexis = inet_csk_ca(sk);
 	struct rnode *rnode = NULL;
 
-	if (flexis->rtt_bin.cnt >= MAX_U32) {
+	if (flexis->rtt_bin.cnt >= MAX_U32 || (flexis->vars->pressure && flexis->rtt_bin.cnt >= PRESSURE_SAMPLES)) {
 		return FULL_QUE;
 	}
 
-	rnode = kzalloc(sizeof(struct rnode), GFP_KERNEL);
+	rnode = flexis_alloc(sk, sizeof(struct rnode));
 	if (unlikely(!rnode)) {
 		return NO_MEM;
 	}
@@ -248,7 +609,7 @@ static void rtt_bin_reset(struct sock *sk)
 	if (!list_empty(&flexis->rtt_bin.head)) {       
 		list_for_each_entry_safe(rnode, tmp, &flexis->rtt_bin.head, links) {
 			list_del(&rnode->links);
-			kfree(rnode);
+			flexis_free(sk, rnode, sizeof(struct rnode));
 		}
 	}
 
@@ -268,7 +629,7 @@ static struct snode *slopes_add_asd(struct sock *sk, struct slopes *slopes, s32
 		return NULL;
 	}
 
-	snode = kzalloc(sizeof(struct snode), GFP_KERNEL);
+	snode = flexis_alloc(sk, sizeof(struct snode));
 	if (unlikely(!snode)) {
 		return NULL;
 	}
@@ -283,6 +644,39 @@ static struct snode *slopes_add_asd(struct sock *sk, struct slopes *slopes, s32
 	return snode;
 }
 
+// adding a new slope to the batch of the deferred decision work, unsorted
+static struct snode *slopes_add_batch(struct sock *sk, s32 slope)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct snode *snode;
+
+	if (flexis->slopes.cnt >= MAX_U32) {
+		return NULL;
+	}
+
+	snode = flexis_alloc(sk, sizeof(struct snode));
+	if (unlikely(!snode)) {
+		return NULL;
+	}
+
+	snode->slope = slope;
+	list_add_tail(&snode->links, &flexis->vars->batch);
+	flexis->slopes.cnt++;
+
+	return snode;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 13, 0)
+static int snode_cmp(void *priv, const struct list_head *a, const struct list_head *b)
+#else
+static int snode_cmp(void *priv, struct list_head *a, struct list_head *b)
+#endif
+{
+	s32 sa = list_entry(a, struct snode, links)->slope, sb = list_entry(b, struct snode, links)->slope;
+
+	return sa < sb ? -1 : sa > sb;
+}
+
 // adding a list of sorted slopes to "slopes" and preserving ascending order
 static int slopes_add_asd_mul(struct sock *sk, struct slopes *new_slopes)
 {
@@ -319,6 +713,40 @@ static int slopes_add_asd_mul(struct sock *sk, struct slopes *new_slopes)
 	return SUCCESS;
 }
 
+// sorting the batch and merging it into "slopes" in one pass
+static void slopes_merge_batch(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct slopes batch;
+	struct snode *snode;
+
+	if (list_empty(&flexis->vars->batch)) {
+		return;
+	}
+
+	list_sort(NULL, &flexis->vars->batch, snode_cmp);
+	batch.cnt = 0;
+	list_for_each_entry(snode, &flexis->vars->batch, links) {
+		batch.cnt++;
+	}
+	list_replace_init(&flexis->vars->batch, &batch.head);
+	// slopes_add_asd_mul counts the slopes again
+	flexis->slopes.cnt -= batch.cnt;
+	slopes_add_asd_mul(sk, &batch);
+}
+
+// freeing the batch, whose slopes are already gone from slopes.cnt
+static void slopes_reset_batch(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct snode *snode, *tmp;
+
+	list_for_each_entry_safe(snode, tmp, &flexis->vars->batch, links) {
+		list_del(&snode->links);
+		flexis_free(sk, snode, sizeof(struct snode));
+	}
+}
+
 // adding a new node to the end of the fanout queue
 static int fanout_enq(struct sock *sk, struct list_head *fanout_head, struct snode *snode)
 {
@@ -328,7 +756,7 @@ static int fanout_enq(struct sock *sk, struct list_head *fanout_head, struct sno
 		return NULL_PTR;
 	}
 
-	fnode = kzalloc(sizeof(struct fnode), GFP_KERNEL);
+	fnode = flexis_alloc(sk, sizeof(struct fnode));
 	if (unlikely(!fnode)) {
 		return NO_MEM;
 	}
@@ -349,6 +777,7 @@ static int slopes_gen(struct sock *sk, struct pnode *stop_pnode)
 	struct snode *snode;
 	struct slopes new_slopes;
 	s32 diff, slope;
+	int rst = SUCCESS, ret;
 
 	if (!stop_pnode) {
 		return NULL_PTR;
@@ -368,14 +797,33 @@ static int slopes_gen(struct sock *sk, struct pnode *stop_pnode)
 		if (diff > 0) {
 			// the slope is magnified 1000 times
 			slope = (s32)(stop_pnode->rtt_us - pnode->rtt_us) / diff; 
-			snode = slopes_add_asd(sk, &new_slopes, slope);
+			snode = flexis->vars->defer ? slopes_add_batch(sk, slope) : slopes_add_asd(sk, &new_slopes, slope);
 			if (!snode) {
-				return NO_MEM;
+				rst = NO_MEM;
+				break;
+			}
+			if (fanout_enq(sk, &pnode->fanout_head, snode)) {
+				// a slope without a fanout entry would outlive its point
+				list_del(&snode->links);
+				flexis_free(sk, snode, sizeof(struct snode));
+				if (flexis->vars->defer) {
+					flexis->slopes.cnt--;
+				} else {
+					new_slopes.cnt--;
+				}
+				rst = NO_MEM;
+				break;
 			}
-			fanout_enq(sk, &pnode->fanout_head, snode);
 		}
 	}
-	return slopes_add_asd_mul(sk, &new_slopes);
+	if (flexis->vars->defer) {
+		// the batch is sorted and merged once, by the next estimate
+		return rst;
+	}
+	// the slopes generated so far are kept, as each of them is reachable from a fanout queue
+	ret = slopes_add_asd_mul(sk, &new_slopes);
+
+	return rst ? rst : ret;
 }
 
 // returning the median of "slopes"
@@ -409,12 +857,13 @@ static int slopes_del(struct sock *sk, struct snode *snode)
 		return NULL_PTR;
 	}
 
-	if (list_empty(&flexis->slopes.head)) {
+	// a slope of the deferred decision work may still be in the batch while slopes.head is empty
+	if (!flexis->slopes.cnt) {
 		return EMPTY_QUE;
 	}
 
 	list_del(&snode->links);
-	kfree(snode);
+	flexis_free(sk, snode, sizeof(struct snode));
 
 	flexis->slopes.cnt--;
 
@@ -437,7 +886,7 @@ static int fout_reset(struct sock *sk, struct list_head *fanout_head)
 	list_for_each_entry_safe(fnode, tmp, fanout_head, links) {
 		slopes_del(sk, fnode->ptr);
 		list_del(&fnode->links);
-		kfree(fnode);
+		flexis_free(sk, fnode, sizeof(struct fnode));
 	} 
 
 	INIT_LIST_HEAD(fanout_head);
@@ -454,7 +903,7 @@ static void slopes_reset(struct sock *sk)
 	if (!list_empty(&flexis->slopes.head)) {
 		list_for_each_entry_safe(snode, tmp, &flexis->slopes.head, links) {
 			list_del(&snode->links);
-			kfree(snode);
+			flexis_free(sk, snode, sizeof(struct snode));
 		}
 	}
 
@@ -462,6 +911,166 @@ static void slopes_reset(struct sock *sk)
 	flexis->slopes.cnt = 0; 
 }
 
+///////// estimator operations //////////////
+
+// Theil-Sen: the median of the slopes of all pairs of points, maintained in "slopes"
+static int theil_sen_add(struct sock *sk, struct pnode *pnode)
+{
+	return slopes_gen(sk, pnode);
+}
+
+static void theil_sen_del(struct sock *sk, struct pnode *pnode)
+{
+	if (!list_empty(&pnode->fanout_head)) {
+		fout_reset(sk, &pnode->fanout_head);
+	}
+}
+
+static int theil_sen_slope(struct sock *sk, s32 *slope)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+
+	slopes_merge_batch(sk);
+	return slopes_median(sk, 1, flexis->slopes.cnt, slope);
+}
+
+static void theil_sen_reset(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct pnode *pnode;
+	struct fnode *fnode, *tmp;
+
+	// the slopes are freed all at once below, only the fanout queues pointing to them are emptied here
+	list_for_each_entry(pnode, &flexis->rtt_sack.head, links) {
+		list_for_each_entry_safe(fnode, tmp, &pnode->fanout_head, links) {
+			list_del(&fnode->links);
+			flexis_free(sk, fnode, sizeof(struct fnode));
+		}
+	}
+	slopes_reset(sk);
+	slopes_reset_batch(sk);
+}
+
+static const struct estimator est_theil_sen = {
+	.add = theil_sen_add,
+	.del = theil_sen_del,
+	.slope = theil_sen_slope,
+	.reset = theil_sen_reset,
+};
+
+// incremental least squares: the slope of the least squares line, maintained in O(1) per point
+static int ols_add(struct sock *sk, struct pnode *pnode)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct ols *ols = &flexis->vars->ols;
+	s64 t;
+
+	if (!ols->n) {
+		ols->t_base = pnode->snd_time_ms;
+	}
+	t = pnode->snd_time_ms - ols->t_base;
+
+	ols->n++;
+	ols->st += t;
+	ols->sd += pnode->rtt_us;
+	ols->stt += t * t;
+	ols->std += t * pnode->rtt_us;
+
+	return ols->n < 2 ? EMPTY_QUE : SUCCESS;
+}
+
+static void ols_del(struct sock *sk, struct pnode *pnode)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct ols *ols = &flexis->vars->ols;
+	s64 t, delta;
+
+	if (!ols->n) {
+		return;
+	}
+
+	t = pnode->snd_time_ms - ols->t_base;
+	ols->n--;
+	ols->st -= t;
+	ols->sd -= pnode->rtt_us;
+	ols->stt -= t * t;
+	ols->std -= t * pnode->rtt_us;
+
+	if (!ols->n || list_is_last(&pnode->links, &flexis->rtt_sack.head)) {
+		memset(ols, 0, sizeof(struct ols));
+		return;
+	}
+
+	// moving the time origin to the next oldest point keeps the sums small
+	delta = list_next_entry(pnode, links)->snd_time_ms - ols->t_base;
+	ols->stt += ols->n * delta * delta - 2 * delta * ols->st;
+	ols->std -= delta * ols->sd;
+	ols->st -= ols->n * delta;
+	ols->t_base += delta;
+}
+
+static int ols_slope(struct sock *sk, s32 *slope)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct ols *ols = &flexis->vars->ols;
+	s64 den;
+
+	if (!slope) {
+		return NULL_PTR;
+	}
+
+	if (ols->n < 2) {
+		return EMPTY_QUE;
+	}
+
+	den = ols->n * ols->stt - ols->st * ols->st;
+	if (den <= 0) {
+		return ZERO_DIV;
+	}
+
+	*slope = div64_s64(ols->n * ols->std - ols->st * ols->sd, den);
+
+	return SUCCESS;
+}
+
+static void ols_reset(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+
+	memset(&flexis->vars->ols, 0, sizeof(struct ols));
+}
+
+static const struct estimator est_ols = {
+	.add = ols_add,
+	.del = ols_del,
+	.slope = ols_slope,
+	.reset = ols_reset,
+};
+
+// the estimators selectable by params.estimator
+static const struct estimator * const estimators[NR_ESTIMATORS] = {
+	&est_theil_sen,
+	&est_ols
+};
+
+// switching the socket to another estimator and feeding it the points in rtt_sack
+static void est_switch(struct sock *sk, const struct estimator *est)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct pnode *pnode;
+
+	if (flexis->vars->est == est) {
+		return;
+	}
+
+	flexis->vars->est->reset(sk);
+	flexis->vars->est = est;
+	est->reset(sk);
+	list_for_each_entry(pnode, &flexis->rtt_sack.head, links) {
+		est->add(sk, pnode);
+	}
+}
+
 ///////// rtt_sack operations //////////////
 
 // adding a new point to rtt_sack
@@ -474,7 +1083,7 @@ static struct pnode * rtt_sack_enq(struct sock *sk, u64 snd_time_ms, u32 rtt_us)
 		return NULL;
 	}
 
-	new_node = kzalloc(sizeof(struct pnode), GFP_KERNEL);
+	new_node = flexis_alloc(sk, sizeof(struct pnode));
 	if (unlikely(!new_node)) {
 		return NULL;
 	}
@@ -499,11 +1108,9 @@ static void rtt_sack_deq(struct sock *sk)
 	if (!list_empty(&flexis->rtt_sack.head)) {
 		fst_tnode = list_first_entry(&flexis->rtt_sack.head, struct pnode, links);
 		if (fst_tnode) {
-			if (!list_empty(&fst_tnode->fanout_head)) {
-				fout_reset(sk, &fst_tnode->fanout_head);
-			}
+			flexis->vars->est->del(sk, fst_tnode);
 			list_del(&fst_tnode->links);
-			kfree(fst_tnode);
+			flexis_free(sk, fst_tnode, sizeof(struct pnode));
 		}
 		flexis->rtt_sack.cnt--;
 	}
@@ -522,73 +1129,371 @@ static void rtt_sack_reset(struct sock *sk)
 	flexis->rtt_sack.cnt = 0;
 }
 
-//////////// other helper operations /////////////
+//////////// group operations /////////////
 
-static bool is_cwnd_limited(struct sock *sk)
+// filling the group key of a socket
+static void group_key(struct sock *sk, u32 *daddr)
 {
-	struct tcp_sock *tp = tcp_sk(sk);
-
-	return tp->snd_cwnd < 2 * tp->max_packets_out;
+	memset(daddr, 0, 4 * sizeof(u32));
+#if IS_ENABLED(CONFIG_IPV6)
+	if (sk->sk_family == AF_INET6 && !ipv6_addr_v4mapped(&sk->sk_v6_daddr)) {
+		memcpy(daddr, &sk->sk_v6_daddr, 4 * sizeof(u32));
+		return;
+	}
+#endif
+	daddr[0] = sk->sk_daddr;
 }
 
-// initializing increase epoch
-static void init_inc_epoch(struct sock *sk)
+// adding the socket to the group of its destination, creating the group if needed
+static void group_join(struct sock *sk)
 {
 	struct flexis *flexis = inet_csk_ca(sk);
-	struct tcp_sock *tp = tcp_sk(sk);
-	
-	if (flexis->vars->epoch_min_rtt)
-		flexis->vars->r0 = div_u64(tp->snd_cwnd * USEC_PER_SEC, flexis->vars->epoch_min_rtt);
-	else if (tp->srtt_us)
-		flexis->vars->r0 = div_u64(tp->snd_cwnd * USEC_PER_SEC, tp->srtt_us >> 3);
-	else 
-		flexis->vars->r0 /= 2;
-	
-	flexis->vars->t0 = tp->tcp_mstamp;
+	struct flexis_net *fn = net_generic(sock_net(sk), flexis_net_id);
+	struct group *group, *new_group;
+	u32 daddr[4], hash;
 
-}
+	if (!READ_ONCE(fn->coupled)) {
+		return;
+	}
 
-static void update_pacing_ratio(struct sock *sk, u32 pr)
-{
-	if (pr)
-		sock_net(sk)->ipv4.sysctl_tcp_pacing_ss_ratio = sock_net(sk)->ipv4.sysctl_tcp_pacing_ca_ratio = pr;
+	group_key(sk, daddr);
+	hash = jhash2(daddr, 4, net_hash_mix(sock_net(sk)));
+	new_group = kzalloc(sizeof(struct group), GFP_ATOMIC);
 
+	spin_lock_bh(&groups_lock);
+	hash_for_each_possible(groups, group, node, hash) {
+		if (net_eq(group->net, sock_net(sk)) && !memcmp(group->daddr, daddr, sizeof(daddr))) {
+			goto found;
+		}
+	}
+	if (unlikely(!new_group)) {
+		spin_unlock_bh(&groups_lock);
+		return;
+	}
+	group = new_group;
+	new_group = NULL;
+	group->net = sock_net(sk);
+	memcpy(group->daddr, daddr, sizeof(daddr));
+	spin_lock_init(&group->lock);
+	hash_add(groups, &group->node, hash);
+	atomic_long_add(sizeof(struct group), &mem_bytes);
+found:
+	group->refcnt++;
+	flexis->vars->group = group;
+	flexis->vars->group_seq = READ_ONCE(group->dec_seq);
+	spin_unlock_bh(&groups_lock);
+
+	kfree(new_group);
 }
 
-static void increase_cwnd(struct sock *sk)
+// removing the socket from its group, freeing the group with its last member
+static void group_leave(struct sock *sk)
 {
-	struct tcp_sock *tp = tcp_sk(sk);
 	struct flexis *flexis = inet_csk_ca(sk);
-	long t1, t2;
-	u64 r1, r2, rem;
-	u32 srtt, pr, dur;
+	struct group *group = flexis->vars->group;
 
-	if (!flexis->vars->t0) { 
+	if (!group) {
 		return;
 	}
-	
-	if (!is_cwnd_limited(sk)) {
-		update_pacing_ratio(sk, 100);
-		if (!flexis->vars->t_ulmt) {
-			flexis->vars->t_ulmt = tp->tcp_mstamp;
-                }
-		return;
+
+	spin_lock_bh(&groups_lock);
+	if (!--group->refcnt) {
+		hash_del(&group->node);
+	} else {
+		group = NULL;
 	}
-	if (!alpha || !beta )
-		return;
-	
-	srtt = tp->srtt_us >> 3;
-	if (!srtt) {
-		return;
+	spin_unlock_bh(&groups_lock);
+
+	if (group) {
+		kfree(group);
+		atomic_long_sub(sizeof(struct group), &mem_bytes);
 	}
-	
-	// right shift t0 when the rate becomes limited by cwnd again to avoid large rate increase
-	if (flexis->vars->t_ulmt) {
-		dur = tp->tcp_mstamp - flexis->vars->t_ulmt;
-		if (dur > 0) {
-			flexis->vars->t0 += dur;
-		}
-		flexis->vars->t_ulmt = 0;
+	flexis->vars->group = NULL;
+}
+
+// returning true if another member has decreased since the last decrease of this socket
+static bool group_dec_pending(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+
+	return flexis->vars->group && READ_ONCE(flexis->vars->group->dec_seq) != flexis->vars->group_seq;
+}
+
+// folding the slope of a member into the shared trend estimate and returning the estimate
+static s32 group_slope(struct sock *sk, s32 slope)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct group *group = flexis->vars->group;
+
+	spin_lock_bh(&group->lock);
+	if (group->slope_valid) {
+		group->slope += (slope - group->slope) >> GROUP_SLOPE_SHIFT;
+	} else {
+		group->slope = slope;
+		group->slope_valid = true;
+	}
+	slope = group->slope;
+	spin_unlock_bh(&group->lock);
+
+	return slope;
+}
+
+/*
+ * recording a decrease of this socket. a new group decrease is started unless the socket is following one
+ * started by another member, so that the group decreases once per congestion event
+ */
+static void group_dec(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct group *group = flexis->vars->group;
+
+	spin_lock_bh(&group->lock);
+	if (group->dec_seq == flexis->vars->group_seq) {
+		group->dec_seq++;
+		group->slope_valid = false;
+		group->t0 = 0;
+	}
+	flexis->vars->group_seq = group->dec_seq;
+	spin_unlock_bh(&group->lock);
+}
+
+/*
+ * returning the start time of the increase epoch shared by the group. the first member starting an epoch 
+ * after a decrease sets it, members starting theirs more than win_us later keep their own t0
+ */
+static u64 group_t0(struct sock *sk, u64 t0, u32 win_us)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct group *group = flexis->vars->group;
+
+	spin_lock_bh(&group->lock);
+	if (!group->t0 || t0 - group->t0 > win_us) {
+		group->t0 = t0;
+	}
+	t0 = group->t0;
+	spin_unlock_bh(&group->lock);
+
+	return t0;
+}
+
+//////////// rate curve operations /////////////
+
+// advancing the quotient q and remainder r of a division by div after the dividend grew by delta
+static inline void curve_step(u32 *q, u32 *r, u32 delta, u32 div)
+{
+	*r += delta;
+	while (*r >= div) {
+		*r -= div;
+		(*q)++;
+	}
+}
+
+// moving a curve position to ms
+static void curve_seek(struct curve_pos *pos, u32 ms, u32 alpha, u32 beta)
+{
+	u32 delta = ms - pos->ms;
+
+	if (ms < pos->ms || delta > CURVE_MAX_STEPS * min(alpha, beta)) {
+		// jumping backwards, e.g. when t0 is shifted, or far ahead
+		pos->qa = ms / alpha;
+		pos->ra = ms % alpha;
+		pos->qb = ms / beta;
+		pos->rb = ms % beta;
+	} else {
+		curve_step(&pos->qa, &pos->ra, delta, alpha);
+		curve_step(&pos->qb, &pos->rb, delta, beta);
+	}
+	pos->ms = ms;
+}
+
+// the rate at a curve position, in packets per second
+static inline u64 curve_rate(const struct curve_pos *pos, u32 r0)
+{
+	return (u64)pos->qa * pos->qa * pos->qa + pos->qb + r0;
+}
+
+// restarting the curve at t = 0
+static void curve_reset(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+
+	memset(&flexis->vars->curve, 0, sizeof(struct curve));
+}
+
+//////////// other helper operations /////////////
+
+// the time of the current ACK in ms, the clock of the RTT filters
+static u32 tcp_ms(struct sock *sk)
+{
+	return div_u64(tcp_sk(sk)->tcp_mstamp, (u32)USEC_PER_MSEC);
+}
+
+// returning the base RTT in us, 0 before the first RTT sample
+static u32 base_rtt(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	u32 rtt = minmax_get(&flexis->vars->base_rtt);
+
+	return rtt == MAX_RTT ? 0 : rtt;
+}
+
+/*
+ * the windowed min update of lib/win_minmax.c. minmax_running_min is only used by the built-in tcp_input.c and not
+ * exported to modules, so flexis carries its own copy
+ */
+static u32 rtt_min_subwin_update(struct minmax *m, u32 win, const struct minmax_sample *val)
+{
+	u32 dt = val->t - m->s[0].t;
+
+	if (unlikely(dt > win)) {
+		// passed the entire window without a new val, so make the 2nd choice the new val and the 3rd choice the
+		// new 2nd choice. we may have to iterate this since our 2nd choice may also be outside the window
+		m->s[0] = m->s[1];
+		m->s[1] = m->s[2];
+		m->s[2] = *val;
+		if (unlikely(val->t - m->s[0].t > win)) {
+			m->s[0] = m->s[1];
+			m->s[1] = m->s[2];
+			m->s[2] = *val;
+		}
+	} else if (unlikely(m->s[1].t == m->s[0].t) && dt > win / 4) {
+		// we've passed a quarter of the window without a new val, so take a 2nd choice from the 2nd quarter
+		m->s[2] = m->s[1] = *val;
+	} else if (unlikely(m->s[2].t == m->s[1].t) && dt > win / 2) {
+		// we've passed half the window without finding a new val, so take a 3rd choice from the last half
+		m->s[2] = *val;
+	}
+
+	return m->s[0].v;
+}
+
+// feeding a sample to a windowed min filter, returning the minimum of the window
+static u32 rtt_running_min(struct minmax *m, u32 win, u32 t, u32 meas)
+{
+	struct minmax_sample val = { .t = t, .v = meas };
+
+	if (unlikely(val.v <= m->s[0].v) || unlikely(val.t - m->s[2].t > win)) {
+		// found a new min, or nothing left in the window
+		return minmax_reset(m, t, meas);
+	}
+	if (unlikely(val.v <= m->s[1].v)) {
+		m->s[2] = m->s[1] = val;
+	} else if (unlikely(val.v <= m->s[2].v)) {
+		m->s[2] = val;
+	}
+
+	return rtt_min_subwin_update(m, win, &val);
+}
+
+/*
+ * feeding an RTT sample to the base RTT filter. a shift of the propagation delay to a lower value shows up at once, 
+ * a shift to a higher value, e.g. after a route change, is taken from the recent RTT filter once it has lasted 
+ * BASE_RTT_DRIFT_MS instead of waiting for the old base RTT to leave the window
+ */
+static void base_rtt_update(struct sock *sk, u32 rtt_us)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	u32 now = tcp_ms(sk), base, recent;
+
+	base = rtt_running_min(&flexis->vars->base_rtt, BASE_RTT_WIN_MS, now, rtt_us);
+	recent = rtt_running_min(&flexis->vars->recent_rtt, RECENT_RTT_WIN_MS, now, rtt_us);
+
+	if (recent - base <= base >> BASE_RTT_DRIFT_SHIFT) {
+		flexis->vars->drift_ms = 0;
+	} else if (!flexis->vars->drift_ms) {
+		flexis->vars->drift_ms = now ? now : 1;
+		flexis->vars->drift_decs = 0;
+	} else if (now - flexis->vars->drift_ms >= BASE_RTT_DRIFT_MS && flexis->vars->drift_decs >= BASE_RTT_DRIFT_DECS) {
+		minmax_reset(&flexis->vars->base_rtt, now, recent);
+		flexis->vars->drift_ms = 0;
+	}
+}
+
+// counting a decrease that did not lower the RTT measured by the first packet sent after it
+static void base_rtt_dec_done(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	u32 dec_rtt = flexis->vars->dec_rtt;
+
+	if (flexis->vars->drift_ms && dec_rtt && flexis->vars->rtt_us > 0 && flexis->vars->rtt_us + (dec_rtt >> BASE_RTT_RESP_SHIFT) >= dec_rtt) {
+		flexis->vars->drift_decs++;
+	}
+	flexis->vars->dec_rtt = 0;
+}
+
+static bool is_cwnd_limited(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	return tp->snd_cwnd < 2 * tp->max_packets_out;
+}
+
+// initializing increase epoch
+static void init_inc_epoch(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct tcp_sock *tp = tcp_sk(sk);
+	u32 rtt = base_rtt(sk);
+	
+	if (rtt)
+		flexis->vars->r0 = div_u64(tp->snd_cwnd * USEC_PER_SEC, rtt);
+	else if (tp->srtt_us)
+		flexis->vars->r0 = div_u64(tp->snd_cwnd * USEC_PER_SEC, tp->srtt_us >> 3);
+	else 
+		flexis->vars->r0 /= 2;
+	
+	flexis->vars->t0 = tp->tcp_mstamp;
+	if (flexis->vars->group) {
+		flexis->vars->t0 = group_t0(sk, tp->tcp_mstamp, rtt ? rtt : tp->srtt_us >> 3);
+	}
+	curve_reset(sk);
+}
+
+static void update_pacing_ratio(struct sock *sk, u32 pr)
+{
+	struct net *net = sock_net(sk);
+
+	// skipping redundant stores, as the ratios are shared by all sockets of the namespace
+	if (pr && (READ_ONCE(net->ipv4.sysctl_tcp_pacing_ca_ratio) != pr || READ_ONCE(net->ipv4.sysctl_tcp_pacing_ss_ratio) != pr))
+		net->ipv4.sysctl_tcp_pacing_ss_ratio = net->ipv4.sysctl_tcp_pacing_ca_ratio = pr;
+
+}
+
+static void increase_cwnd(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct curve *curve = &flexis->vars->curve;
+	long t1, t2;
+	u64 r1, r2, rem;
+	u32 srtt, dur, rtt;
+
+	if (!flexis->vars->t0) { 
+		return;
+	}
+	
+	if (!is_cwnd_limited(sk)) {
+		update_pacing_ratio(sk, 100);
+		if (!flexis->vars->t_ulmt) {
+			flexis->vars->t_ulmt = tp->tcp_mstamp;
+                }
+		return;
+	}
+	if (!flexis->vars->p.alpha || !flexis->vars->p.beta)
+		return;
+	
+	srtt = tp->srtt_us >> 3;
+	if (!srtt) {
+		return;
+	}
+	
+	// right shift t0 when the rate becomes limited by cwnd again to avoid large rate increase
+	if (flexis->vars->t_ulmt) {
+		dur = tp->tcp_mstamp - flexis->vars->t_ulmt;
+		if (dur > 0) {
+			flexis->vars->t0 += dur;
+		}
+		flexis->vars->t_ulmt = 0;
 	}
 	
 	// t1 is the current elapsed time
@@ -598,12 +1503,14 @@ static void increase_cwnd(struct sock *sk)
 	}
 	
 	// r1 is the current rate, in packets per second
-	r1 = int_pow(t1 / USEC_PER_MSEC / alpha, 3) + t1 / USEC_PER_MSEC / beta  + flexis->vars->r0;
+	curve_seek(&curve->now, t1 / USEC_PER_MSEC, flexis->vars->p.alpha, flexis->vars->p.beta);
+	r1 = curve_rate(&curve->now, flexis->vars->r0);
 	if (!r1)
 		return;
 	
-	if (flexis->vars->epoch_min_rtt) {
-		tp->snd_cwnd = max(tp->snd_cwnd, min_t(u32, div_u64(r1 * flexis->vars->epoch_min_rtt, (u32)USEC_PER_SEC), tp->snd_cwnd_clamp));
+	rtt = base_rtt(sk);
+	if (rtt) {
+		tp->snd_cwnd = max(tp->snd_cwnd, min_t(u32, div_u64(r1 * rtt, (u32)USEC_PER_SEC), tp->snd_cwnd_clamp));
 	} else {
 		tp->snd_cwnd = max(tp->snd_cwnd, min_t(u32, div_u64(r1 * srtt, (u32)USEC_PER_SEC), tp->snd_cwnd_clamp));
 	}
@@ -611,18 +1518,23 @@ static void increase_cwnd(struct sock *sk)
 	flexis->vars->undo_cwnd = tp->snd_cwnd;
 	
 	// t2 is the elapsed time in one RTT 
-	if (flexis->vars->epoch_min_rtt) {
-		t2 = t1 + flexis->vars->epoch_min_rtt;
+	if (rtt) {
+		t2 = t1 + rtt;
 	} else {
 		t2 = t1 + srtt;
 	}
 	// r2 is the rate in one RTT
-	r2 = int_pow(t2 / USEC_PER_MSEC / alpha, 3) + t2 / USEC_PER_MSEC / beta + flexis->vars->r0;
-	// calculating pacing ratio 
-	pr = div64_u64_rem(r2 * 100, r1, &rem);
-	if (rem)
-		pr++;
-	update_pacing_ratio(sk, pr);
+	curve_seek(&curve->ahead, t2 / USEC_PER_MSEC, flexis->vars->p.alpha, flexis->vars->p.beta);
+	r2 = curve_rate(&curve->ahead, flexis->vars->r0);
+	// calculating pacing ratio, which only changes when r1 or r2 does
+	if (r1 != curve->r1 || r2 != curve->r2) {
+		curve->r1 = r1;
+		curve->r2 = r2;
+		curve->pr = div64_u64_rem(r2 * 100, r1, &rem);
+		if (rem)
+			curve->pr++;
+	}
+	update_pacing_ratio(sk, curve->pr);
 }
 
 static void decrease_cwnd(struct sock *sk)
@@ -630,26 +1542,516 @@ static void decrease_cwnd(struct sock *sk)
 	struct tcp_sock *tp = tcp_sk(sk);
 	struct flexis *flexis = inet_csk_ca(sk);
 	
-	tp->snd_cwnd = min(tp->snd_cwnd, max_t(u32, div_u64((u64)tp->snd_cwnd * gamma, 100), MIN_CWND));
+	tp->snd_cwnd = min(tp->snd_cwnd, max_t(u32, div_u64((u64)tp->snd_cwnd * flexis->vars->p.gamma, 100), MIN_CWND));
+	flexis->vars->dec_rtt = max_t(s32, flexis->vars->rtt_us, 0);
 
 	flexis->vars->undo_cwnd = tp->snd_cwnd;
 }
 
+// emptying rtt_sack for a new epoch, on the ACK path or in the deferred decision work
+static void sack_reinit(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	unsigned long max = READ_ONCE(mem_max), sock_max = READ_ONCE(sock_mem_max);
+
+	// relaxing the thinning when the last epoch used well under both caps
+	if (flexis->vars->thin_ms && !flexis->vars->pressure && (!max || atomic_long_read(&mem_bytes) < (max >> 2)) && 
+			(!sock_max || atomic_read(&flexis->vars->mem) < (sock_max >> 2))) {
+		flexis->vars->thin_ms >>= 1;
+	}
+
+	rtt_sack_reset(sk);
+	flexis->vars->est->reset(sk);
+	// an epoch starting under memory pressure keeps the cheaper estimator
+	flexis->vars->est = flexis->vars->pressure ? &est_ols : estimators[flexis->vars->p.estimator];
+	flexis->vars->est->reset(sk);
+}
+
 // reinitializing data structures after cwnd reduction
 static void reinit_after_dec(struct sock *sk)
 {
 	struct flexis *flexis = inet_csk_ca(sk);
 
 	rtt_bin_reset(sk);
-	rtt_sack_reset(sk);
-	slopes_reset(sk);
+	if (flexis->vars->defer) {
+		// rtt_sack belongs to the deferred decision work, which resets it when it meets a point of the new gen
+		WRITE_ONCE(flexis->vars->defer->gen, flexis->vars->defer->gen + 1);
+	} else {
+		sack_reinit(sk);
+	}
 	flexis->vars->t0 = 0;
-	flexis->vars->epoch_min_rtt = MAX_RTT;
 	flexis->vars->snd_nxt = 0;
 	flexis->vars->t_ulmt = 0;
+	WRITE_ONCE(flexis->vars->last_slope, NO_SLOPE);
+	update_pacing_ratio(sk, 100);
+}
+
+/*
+ * restarting the increase epoch from the cwnd left by a non-congestive loss. rtt_sack and the base RTT are kept, 
+ * so the next closed rtt_bin can start the new epoch
+ */
+static void reinit_after_mild_loss(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+
+	flexis->vars->mild_loss = false;
+	if (flexis->vars->defer) {
+		// a new gen, so that the next verdict of the work is applied even if it equals the last one
+		WRITE_ONCE(flexis->vars->defer->keep_gen, flexis->vars->defer->gen + 1);
+		smp_store_release(&flexis->vars->defer->gen, flexis->vars->defer->gen + 1);
+	}
+	flexis->vars->t0 = 0;
+	flexis->vars->t_ulmt = 0;
 	update_pacing_ratio(sk, 100);
 }
 
+// returning true if the delay trend and the queueing delay at the time of a loss show no queue build-up
+static bool loss_is_mild(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	s32 slope = READ_ONCE(flexis->vars->last_slope);
+	u32 min_rtt = base_rtt(sk);
+
+	if (!flexis->vars->p.loss_mode || slope == NO_SLOPE || slope >= flexis->vars->p.theta) {
+		return false;
+	}
+	if (flexis->vars->rtt_us < 0 || !min_rtt) {
+		return false;
+	}
+
+	return flexis->vars->rtt_us - min_rtt <= min_rtt >> LOSS_QUEUE_SHIFT;
+}
+
+/*
+ * adding the median of a closed rtt_bin to rtt_sack and estimating the trend once rtt_sack spans tau. 
+ * the oldest point is removed after every estimate that finds no congestion. without "estimate", the window
+ * slides as if no congestion was found and the decision is left to a later point
+ */
+static enum decision sack_add_point(struct sock *sk, u64 snd_time_ms, u32 med_rtt, bool estimate)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct pnode *new_pnode;
+	u32 dur;
+	s32 theil_slope;
+	u64 gap;
+	int rst;
+
+	if (flexis_mem_pressure(sk)) {
+		// falling back to the estimator that needs no slopes, then shrinking rtt_sack
+		est_switch(sk, &est_ols);
+		while (flexis->rtt_sack.cnt > max_t(u32, PRESSURE_POINTS, flexis->vars->p.sigma)) {
+			rtt_sack_deq(sk);
+		}
+	}
+	if (flexis->vars->thin_ms && !list_empty(&flexis->rtt_sack.head)) {
+		// thinning rtt_sack so that fewer points span tau
+		gap = snd_time_ms - list_last_entry(&flexis->rtt_sack.head, struct pnode, links)->snd_time_ms;
+		if (gap < flexis->vars->thin_ms) {
+			return NO_DECISION;
+		}
+	}
+	new_pnode = rtt_sack_enq(sk, snd_time_ms, med_rtt);
+	if (!new_pnode) {
+		return NO_DECISION;
+	}
+	rst = flexis->vars->est->add(sk, new_pnode);
+	if (rst) {
+		if (rst == NO_MEM) {
+			// giving up the oldest point and its slopes so that the next point fits
+			rtt_sack_deq(sk);
+		}
+		return NO_DECISION;
+	}
+
+	dur = max_t(s64, list_last_entry(&flexis->rtt_sack.head, struct pnode, links)->snd_time_ms - list_first_entry(&flexis->rtt_sack.head, struct pnode, links)->snd_time_ms + 1, 0);
+	if (dur < flexis->vars->p.tau) {
+		return NO_DECISION;
+	}
+	if (!estimate) {
+		rtt_sack_deq(sk);
+		return NO_DECISION;
+	}
+
+	// making congestion decision
+	if (flexis->rtt_sack.cnt >= flexis->vars->p.sigma && !flexis->vars->est->slope(sk, &theil_slope)) {
+		if (flexis->vars->group) {
+			theil_slope = group_slope(sk, theil_slope);
+		}
+		WRITE_ONCE(flexis->vars->last_slope, theil_slope);
+		if (theil_slope >= flexis->vars->p.theta) { 
+			return CONGESTION;
+		}
+	}
+	// removing the oldest point from rtt_sack
+	rtt_sack_deq(sk);
+
+	return NO_CONGESTION;
+}
+
+/////////////// deferred decision operations ////////////////
+#ifdef FLEXIS_DEFER
+
+/*
+ * processing the closed rtt_bins handed over by the ACK path. points of an old gen are dropped, as are the points 
+ * following a congestion decision until the ACK path starts a new gen
+ */
+static enum hrtimer_restart defer_work(struct hrtimer *timer)
+{
+	struct defer *defer = container_of(timer, struct defer, timer);
+	struct sock *sk = defer->sk;
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct dpoint *point;
+	enum decision dec;
+	u32 tail = defer->tail, head, gen;
+
+	// points produced from here on are either seen below or start the timer again
+	WRITE_ONCE(defer->armed, 0);
+	smp_mb();
+
+	head = smp_load_acquire(&defer->head);
+	for (; tail != head; tail++) {
+		point = &defer->ring[tail & (DEFER_RING - 1)];
+		gen = smp_load_acquire(&defer->gen);
+		if (point->gen != gen || defer->verdict == ((gen << DEFER_GEN_SHIFT) | CONGESTION)) {
+			continue;
+		}
+		if (defer->sack_gen != gen) {
+			if (READ_ONCE(defer->keep_gen) != gen) {
+				sack_reinit(sk);
+			}
+			defer->sack_gen = gen;
+		}
+		// with defer_batch, the trend is only estimated at the last point of a batch, the most costly part of the work
+		dec = sack_add_point(sk, point->snd_time_ms, point->rtt_us, !flexis->vars->p.defer_batch || tail + 1 == head);
+		if (dec != NO_DECISION) {
+			smp_store_release(&defer->verdict, (gen << DEFER_GEN_SHIFT) | dec);
+		}
+	}
+	smp_store_release(&defer->tail, tail);
+
+	return HRTIMER_NORESTART;
+}
+
+// handing a closed rtt_bin to the deferred decision work, the point is dropped if the ring is full
+static void defer_enq(struct sock *sk, u64 snd_time_ms, u32 med_rtt)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct defer *defer = flexis->vars->defer;
+	struct dpoint *point;
+	u32 head = defer->head;
+
+	if (head - smp_load_acquire(&defer->tail) >= DEFER_RING) {
+		return;
+	}
+	point = &defer->ring[head & (DEFER_RING - 1)];
+	point->snd_time_ms = snd_time_ms;
+	point->rtt_us = med_rtt;
+	point->gen = defer->gen;
+	smp_store_release(&defer->head, head + 1);
+
+	if (!xchg(&defer->armed, 1)) {
+		hrtimer_start(&defer->timer, ns_to_ktime((u64)flexis->vars->p.defer_us * NSEC_PER_USEC), HRTIMER_MODE_REL_PINNED_SOFT);
+	}
+}
+
+// returning a decision of the deferred decision work that the ACK path has not applied yet
+static enum decision defer_verdict(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct defer *defer = flexis->vars->defer;
+	u32 verdict = smp_load_acquire(&defer->verdict);
+
+	if (verdict == defer->seen || verdict >> DEFER_GEN_SHIFT != (defer->gen & (MAX_U32 >> DEFER_GEN_SHIFT))) {
+		return NO_DECISION;
+	}
+	defer->seen = verdict;
+
+	return verdict & ((1U << DEFER_GEN_SHIFT) - 1);
+}
+
+// setting up the deferred decision work if the profile of the socket asks for it
+static void defer_init(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct defer *defer;
+
+	if (!flexis->vars->p.defer_us) {
+		return;
+	}
+	defer = flexis_alloc(sk, sizeof(struct defer));
+	if (!defer) {
+		// making decisions on the ACK path instead
+		return;
+	}
+	defer->sk = sk;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(&defer->timer, defer_work, CLOCK_MONOTONIC, HRTIMER_MODE_REL_PINNED_SOFT);
+#else
+	hrtimer_init(&defer->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_PINNED_SOFT);
+	defer->timer.function = defer_work;
+#endif
+	flexis->vars->defer = defer;
+}
+
+// stopping the deferred decision work, after which rtt_sack belongs to the caller again
+static void defer_release(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+
+	if (!flexis->vars->defer) {
+		return;
+	}
+	hrtimer_cancel(&flexis->vars->defer->timer);
+	flexis_free(sk, flexis->vars->defer, sizeof(struct defer));
+	flexis->vars->defer = NULL;
+}
+#else
+static void defer_enq(struct sock *sk, u64 snd_time_ms, u32 med_rtt) { }
+static enum decision defer_verdict(struct sock *sk) { return NO_DECISION; }
+static void defer_init(struct sock *sk) { }
+static void defer_release(struct sock *sk) { }
+#endif
+
+/////////////// profile operations ////////////////
+
+static int zero;
+static int one = 1;
+static int hundred = 100;
+static int max_profile = NR_PROFILES - 1;
+static int max_estimator = NR_ESTIMATORS - 1;
+static int max_defer_us = DEFER_MAX_US;
+
+static const char * const profile_paths[NR_PROFILES] = {
+	"net/flexis/default",
+	"net/flexis/latency",
+	"net/flexis/bulk",
+	"net/flexis/custom"
+};
+
+// the template of the sysctl table of a profile, .data is filled in per network namespace
+static struct ctl_table profile_table[] = {
+	{ .procname = "sigma", .maxlen = sizeof(int), .mode = 0644, .proc_handler = proc_dointvec_minmax, .extra1 = &one },
+	{ .procname = "alpha", .maxlen = sizeof(int), .mode = 0644, .proc_handler = proc_dointvec_minmax, .extra1 = &one },
+	{ .procname = "beta", .maxlen = sizeof(int), .mode = 0644, .proc_handler = proc_dointvec_minmax, .extra1 = &one },
+	{ .procname = "gamma", .maxlen = sizeof(int), .mode = 0644, .proc_handler = proc_dointvec_minmax, .extra1 = &one, .extra2 = &hundred },
+	{ .procname = "tau", .maxlen = sizeof(int), .mode = 0644, .proc_handler = proc_dointvec_minmax, .extra1 = &one },
+	{ .procname = "theta", .maxlen = sizeof(int), .mode = 0644, .proc_handler = proc_dointvec },
+	{ .procname = "estimator", .maxlen = sizeof(int), .mode = 0644, .proc_handler = proc_dointvec_minmax, .extra1 = &zero, .extra2 = &max_estimator },
+	{ .procname = "defer_us", .maxlen = sizeof(int), .mode = 0644, .proc_handler = proc_dointvec_minmax, .extra1 = &zero, .extra2 = &max_defer_us },
+	{ .procname = "loss_mode", .maxlen = sizeof(int), .mode = 0644, .proc_handler = proc_dointvec_minmax, .extra1 = &zero, .extra2 = &one },
+	{ .procname = "loss_gamma", .maxlen = sizeof(int), .mode = 0644, .proc_handler = proc_dointvec_minmax, .extra1 = &one, .extra2 = &hundred },
+	{ .procname = "defer_batch", .maxlen = sizeof(int), .mode = 0644, .proc_handler = proc_dointvec_minmax, .extra1 = &zero, .extra2 = &one },
+	{ }
+};
+
+// the template of the top level sysctl table
+static struct ctl_table flexis_table[] = {
+	{ .procname = "profile", .maxlen = sizeof(int), .mode = 0644, .proc_handler = proc_dointvec_minmax, .extra1 = &zero, .extra2 = &max_profile },
+	{ .procname = "mark_mask", .maxlen = sizeof(unsigned int), .mode = 0644, .proc_handler = proc_douintvec },
+	{ .procname = "coupled", .maxlen = sizeof(int), .mode = 0644, .proc_handler = proc_dointvec_minmax, .extra1 = &zero, .extra2 = &one },
+	{ }
+};
+
+// the host wide memory caps and statistics, only registered in init_net
+static struct ctl_table mem_table[] = {
+	{ .procname = "mem_max", .data = &mem_max, .maxlen = sizeof(unsigned long), .mode = 0644, .proc_handler = proc_doulongvec_minmax },
+	{ .procname = "sock_mem_max", .data = &sock_mem_max, .maxlen = sizeof(unsigned long), .mode = 0644, .proc_handler = proc_doulongvec_minmax },
+	{ .procname = "mem_bytes", .data = &mem_bytes, .maxlen = sizeof(unsigned long), .mode = 0444, .proc_handler = proc_doulongvec_minmax },
+	{ .procname = "mem_pressure", .data = &mem_pressure, .maxlen = sizeof(unsigned long), .mode = 0444, .proc_handler = proc_doulongvec_minmax },
+	{ .procname = "mem_fails", .data = &mem_fails, .maxlen = sizeof(unsigned long), .mode = 0444, .proc_handler = proc_doulongvec_minmax },
+	{ }
+};
+
+// filling a profile with the module parameters
+static void params_init(struct params *p)
+{
+	p->sigma = sigma;
+	p->alpha = alpha;
+	p->beta = beta;
+	p->gamma = gamma;
+	p->tau = tau;
+	p->theta = theta;
+	p->estimator = 0;
+	p->defer_us = 0;
+	p->loss_mode = 0;
+	p->loss_gamma = 90;
+	p->defer_batch = 0;
+}
+
+// the field of a profile set by the module parameter at "param"
+static int *params_field(struct params *p, const int *param)
+{
+	if (param == &sigma) {
+		return &p->sigma;
+	}
+	if (param == &alpha) {
+		return &p->alpha;
+	}
+	if (param == &beta) {
+		return &p->beta;
+	}
+	if (param == &gamma) {
+		return &p->gamma;
+	}
+	if (param == &tau) {
+		return &p->tau;
+	}
+	return &p->theta;
+}
+
+/*
+ * writing a module parameter within the bounds of its sysctl. once the module is registered, the value is also
+ * written to the default profile of init_net, so that the parameters keep tuning the sockets created afterwards
+ */
+static int profile_param_set(const char *val, const struct kernel_param *kp)
+{
+	struct flexis_net *fn;
+	int v, ret;
+
+	ret = kstrtoint(val, 0, &v);
+	if (ret) {
+		return ret;
+	}
+	if ((kp->arg != &theta && v < 1) || (kp->arg == &gamma && v > 100)) {
+		return -EINVAL;
+	}
+	WRITE_ONCE(*(int *)kp->arg, v);
+
+	// writes are serialized with the registration by kernel_param_lock
+	if (profiles_ready) {
+		fn = net_generic(&init_net, flexis_net_id);
+		WRITE_ONCE(*params_field(&fn->profiles[0], kp->arg), v);
+	}
+
+	return 0;
+}
+
+// copying the profile selected for the socket into its vars
+static void params_resolve(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct flexis_net *fn = net_generic(sock_net(sk), flexis_net_id);
+	unsigned int mask = READ_ONCE(fn->mark_mask);
+	unsigned int v = 0;
+	int idx = READ_ONCE(fn->profile);
+
+	if (mask) {
+		v = (sk->sk_mark & mask) >> __ffs(mask);
+	}
+	if (v && v <= NR_PROFILES) {
+		idx = v - 1;
+	}
+	if (idx < 0 || idx >= NR_PROFILES) {
+		idx = 0;
+	}
+
+	flexis->vars->p = fn->profiles[idx];
+}
+
+static void flexis_net_unregister(struct flexis_net *fn)
+{
+	const struct ctl_table *table;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(fn->hdrs); i++) {
+		if (!fn->hdrs[i]) {
+			continue;
+		}
+		table = fn->hdrs[i]->ctl_table_arg;
+		unregister_net_sysctl_table(fn->hdrs[i]);
+		kfree(table);
+		fn->hdrs[i] = NULL;
+	}
+}
+
+static int __net_init flexis_net_init(struct net *net)
+{
+	struct flexis_net *fn = net_generic(net, flexis_net_id);
+	struct ctl_table *table;
+	struct params *p;
+	int i;
+
+	fn->profile = 0;
+	fn->mark_mask = 0;
+	fn->coupled = 0;
+	for (i = 0; i < NR_PROFILES; i++) {
+		params_init(&fn->profiles[i]);
+	}
+	// a latency profile that reacts to smaller delay trends and backs off harder
+	fn->profiles[1].theta = theta * 2 / 3;
+	fn->profiles[1].gamma = 80;
+	// a bulk profile that tolerates larger delay trends and backs off softly
+	fn->profiles[2].theta = theta * 3 / 2;
+	fn->profiles[2].gamma = 90;
+
+	for (i = 0; i < NR_PROFILES; i++) {
+		table = kmemdup(profile_table, sizeof(profile_table), GFP_KERNEL);
+		if (!table) {
+			goto err;
+		}
+		p = &fn->profiles[i];
+		table[0].data = &p->sigma;
+		table[1].data = &p->alpha;
+		table[2].data = &p->beta;
+		table[3].data = &p->gamma;
+		table[4].data = &p->tau;
+		table[5].data = &p->theta;
+		table[6].data = &p->estimator;
+		table[7].data = &p->defer_us;
+		table[8].data = &p->loss_mode;
+		table[9].data = &p->loss_gamma;
+		table[10].data = &p->defer_batch;
+		fn->hdrs[i] = flexis_register_sysctl(net, profile_paths[i], table, ARRAY_SIZE(profile_table) - 1);
+		if (!fn->hdrs[i]) {
+			kfree(table);
+			goto err;
+		}
+	}
+
+	table = kmemdup(flexis_table, sizeof(flexis_table), GFP_KERNEL);
+	if (!table) {
+		goto err;
+	}
+	table[0].data = &fn->profile;
+	table[1].data = &fn->mark_mask;
+	table[2].data = &fn->coupled;
+	fn->hdrs[NR_PROFILES] = flexis_register_sysctl(net, "net/flexis", table, ARRAY_SIZE(flexis_table) - 1);
+	if (!fn->hdrs[NR_PROFILES]) {
+		kfree(table);
+		goto err;
+	}
+
+	if (net_eq(net, &init_net)) {
+		table = kmemdup(mem_table, sizeof(mem_table), GFP_KERNEL);
+		if (!table) {
+			goto err;
+		}
+		fn->hdrs[NR_PROFILES + 1] = flexis_register_sysctl(net, "net/flexis", table, ARRAY_SIZE(mem_table) - 1);
+		if (!fn->hdrs[NR_PROFILES + 1]) {
+			kfree(table);
+			goto err;
+		}
+	}
+
+	return 0;
+
+err:
+	flexis_net_unregister(fn);
+	return -ENOMEM;
+}
+
+static void __net_exit flexis_net_exit(struct net *net)
+{
+	flexis_net_unregister(net_generic(net, flexis_net_id));
+}
+
+static struct pernet_operations flexis_net_ops = {
+	.init = flexis_net_init,
+	.exit = flexis_net_exit,
+	.id = &flexis_net_id,
+	.size = sizeof(struct flexis_net),
+};
+
 /////////////// system operations ////////////////
 
 static void tcp_flexis_init(struct sock *sk)
@@ -661,6 +2063,7 @@ static void tcp_flexis_init(struct sock *sk)
 	if (unlikely(!flexis->vars)) {
 		return;
 	} 
+	atomic_long_add(sizeof(struct vars), &mem_bytes);
 	
 	flexis->vars->t0 = 0;
 	flexis->vars->r0 = 0;
@@ -668,7 +2071,13 @@ static void tcp_flexis_init(struct sock *sk)
 	flexis->vars->undo_cwnd = tp->snd_cwnd;
 	flexis->vars->snd_nxt = 0;
 	flexis->vars->rtt_us = -1;
-	flexis->vars->epoch_min_rtt = MAX_RTT;
+	minmax_reset(&flexis->vars->base_rtt, tcp_ms(sk), MAX_RTT);
+	minmax_reset(&flexis->vars->recent_rtt, tcp_ms(sk), MAX_RTT);
+	flexis->vars->last_slope = NO_SLOPE;
+	params_resolve(sk);
+	flexis->vars->est = estimators[flexis->vars->p.estimator];
+	group_join(sk);
+	defer_init(sk);
 	INIT_LIST_HEAD(&flexis->rtt_bin.head);
 	flexis->rtt_bin.snd_time_ms = 0;
 	flexis->rtt_bin.cnt = 0;
@@ -676,6 +2085,7 @@ static void tcp_flexis_init(struct sock *sk)
 	flexis->rtt_sack.cnt = 0;
 	INIT_LIST_HEAD(&flexis->slopes.head);
 	flexis->slopes.cnt = 0;
+	INIT_LIST_HEAD(&flexis->vars->batch);
 	cmpxchg(&sk->sk_pacing_status, SK_PACING_NONE, SK_PACING_NEEDED);
 	update_pacing_ratio(sk, 100);
 }
@@ -683,8 +2093,18 @@ static void tcp_flexis_init(struct sock *sk)
 u32 tcp_flexis_ssthresh(struct sock *sk)
 {
 	struct tcp_sock *tp = tcp_sk(sk);
+	struct flexis *flexis = inet_csk_ca(sk);
 	u32 thr;
 	
+	if (flexis->vars && !flexis->vars->ece && loss_is_mild(sk)) {
+		// the loss is not caused by a queue at the bottleneck
+		flexis->vars->mild_loss = true;
+		return max_t(u32, div_u64((u64)tp->snd_cwnd * flexis->vars->p.loss_gamma, 100), MIN_CWND);
+	}
+	if (flexis->vars) {
+		flexis->vars->mild_loss = false;
+	}
+
 	thr = max(tp->snd_cwnd >> 1, MIN_CWND);
 	
 	return thr;
@@ -706,7 +2126,7 @@ static void tcp_flexis_cwnd_event(struct sock *sk, enum tcp_ca_event ev)
 {
 	struct tcp_sock *tp = tcp_sk(sk);
 	struct flexis *flexis = inet_csk_ca(sk);
-	bool reinit = true;
+	bool reinit = true, mild = false;
 
 	if (!flexis->vars) {
 		return;
@@ -720,15 +2140,20 @@ static void tcp_flexis_cwnd_event(struct sock *sk, enum tcp_ca_event ev)
 			// TCP reduced cwnd while flexis was reducing it. We undo the second cwnd reduction
 			tp->snd_cwnd = flexis->vars->undo_cwnd;
 		}
+		mild = flexis->vars->mild_loss && !flexis->vars->snd_nxt;
 		break;
 	case CA_EVENT_LOSS: 
+		mild = flexis->vars->mild_loss && !flexis->vars->snd_nxt;
 		break;
 	default:
 		reinit = false;
 		break;
 	}
 	
-	if (reinit) {
+	if (mild) {
+		// keeping the delay history of a non-congestive loss
+		reinit_after_mild_loss(sk);
+	} else if (reinit) {
 		reinit_after_dec(sk);
 	}
 }
@@ -737,12 +2162,9 @@ static void tcp_flexis_cong_avoid(struct sock *sk, u32 ack, u32 acked)
 {
 	struct tcp_sock *tp = tcp_sk(sk);
 	struct flexis *flexis = inet_csk_ca(sk);
-	struct pnode *new_pnode;
 	u64 snd_time_us, snd_time_ms;
-	u32 dur, med_rtt;
-	s32 theil_slope;
-	bool reasoning = false;
-	int rst;
+	u32 med_rtt;
+	enum decision dec = NO_DECISION;
 
 	if (!flexis->vars) {
 		return;
@@ -767,63 +2189,67 @@ static void tcp_flexis_cong_avoid(struct sock *sk, u32 ack, u32 acked)
 			return;
 		} else { 
 			// the rtt sample measured by the first packet sent after cwnd reduction has arrived
+			base_rtt_dec_done(sk);
 			reinit_after_dec(sk);
 		}
 	}
-	
-	if (flexis->vars->rtt_us < flexis->vars->epoch_min_rtt)
-			flexis->vars->epoch_min_rtt = flexis->vars->rtt_us;
-
-	if (snd_time_ms == flexis->rtt_bin.snd_time_ms) {
-		// rtt sample compression
-		rtt_bin_add_asd(sk, snd_time_ms, flexis->vars->rtt_us);
-	} else { 
-		if (!list_empty(&flexis->rtt_bin.head)) {
-			rst = rtt_bin_median(sk, &med_rtt);
-			new_pnode = rtt_sack_enq(sk, flexis->rtt_bin.snd_time_ms, med_rtt);
-			if (new_pnode) {
-				if (!slopes_gen(sk, new_pnode)) {
-					reasoning = true;
-				}
-			} 
-			rtt_bin_reset(sk);
-			rtt_bin_add_asd(sk, snd_time_ms, flexis->vars->rtt_us); 
-		} else {      
-			rtt_bin_add_asd(sk, snd_time_ms, flexis->vars->rtt_us);
-		}
-	} 
 
-	if (!list_empty(&flexis->rtt_sack.head)) {
-		dur = max_t(s64, list_last_entry(&flexis->rtt_sack.head, struct pnode, links)->snd_time_ms - list_first_entry(&flexis->rtt_sack.head, struct pnode, links)->snd_time_ms + 1, 0);
-	} else {
-		dur = 0;
+	if (group_dec_pending(sk)) {
+		// another flow of the group has detected congestion, follow its decrease
+		group_dec(sk);
+		flexis->vars->snd_nxt = tp->snd_nxt;
+		decrease_cwnd(sk);
+		update_pacing_ratio(sk, 100);
+		return;
 	}
 
-	// making congestion decision
-	if (reasoning && dur >= tau) { 
-		if (flexis->rtt_sack.cnt < sigma) {
-			goto inc;
+	if (snd_time_ms != flexis->rtt_bin.snd_time_ms && !list_empty(&flexis->rtt_bin.head)) {
+		// the rtt_bin is closed, its median becomes a point of rtt_sack
+		rtt_bin_median(sk, &med_rtt);
+		if (flexis->vars->defer) {
+			defer_enq(sk, flexis->rtt_bin.snd_time_ms, med_rtt);
+		} else {
+			dec = sack_add_point(sk, flexis->rtt_bin.snd_time_ms, med_rtt, true);
 		}
-		rst = slopes_median(sk, 1, flexis->slopes.cnt, &theil_slope);
-		if (theil_slope >= theta) { 
-			// congestion detected, decrease cwnd
-			flexis->vars->snd_nxt = tp->snd_nxt;
-			decrease_cwnd(sk);
-			update_pacing_ratio(sk, 100);
-			return;
-		} 
-		inc:
-		if (!flexis->vars->t0) {
-			init_inc_epoch(sk);
+		rtt_bin_reset(sk);
+	}
+	// rtt sample compression
+	rtt_bin_add_asd(sk, snd_time_ms, flexis->vars->rtt_us);
+
+	if (flexis->vars->defer) {
+		dec = defer_verdict(sk);
+	}
+
+	if (dec == CONGESTION) {
+		// congestion detected, decrease cwnd
+		if (flexis->vars->group) {
+			group_dec(sk);
 		}
-		// removing the oldest point from rtt_sack
-		rtt_sack_deq(sk);
+		flexis->vars->snd_nxt = tp->snd_nxt;
+		decrease_cwnd(sk);
+		update_pacing_ratio(sk, 100);
+		return;
+	}
+	if (dec == NO_CONGESTION && !flexis->vars->t0) {
+		init_inc_epoch(sk);
 	}
 
 	// increasing cwnd if allowed
 	increase_cwnd(sk);
 }
 
+// remembering whether the ACK carries ECE. TCP reports it before the ssthresh call of tcp_enter_cwr
+static void tcp_flexis_in_ack_event(struct sock *sk, u32 flags)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+
+	if (!flexis->vars) {
+		return;
+	}
+
+	flexis->vars->ece = flags & CA_ACK_ECE;
+}
+
 static void tcp_flexis_pkts_acked(struct sock *sk, const struct ack_sample *sample)
 {
 	struct flexis *flexis = inet_csk_ca(sk);
@@ -833,6 +2259,9 @@ static void tcp_flexis_pkts_acked(struct sock *sk, const struct ack_sample *samp
 	}
 
 	flexis->vars->rtt_us = sample->rtt_us;
+	if (sample->rtt_us > 0) {
+		base_rtt_update(sk, sample->rtt_us);
+	}
 }
 
 static void tcp_flexis_release(struct sock *sk)
@@ -843,10 +2272,16 @@ static void tcp_flexis_release(struct sock *sk)
 		return;
 	}
 
+	defer_release(sk);
 	rtt_bin_reset(sk);
 	rtt_sack_reset(sk);
-	slopes_reset(sk);
+	flexis->vars->est->reset(sk);
+	group_leave(sk);
+	if (flexis->vars->pressure) {
+		atomic_long_dec(&mem_pressure);
+	}
 	kfree(flexis->vars);
+	atomic_long_sub(sizeof(struct vars), &mem_bytes);
 	flexis->vars = NULL;
 }
 
@@ -856,21 +2291,48 @@ static struct tcp_congestion_ops tcp_flexis __read_mostly = {
 		.undo_cwnd	= tcp_flexis_undo_cwnd, 
 		.cwnd_event = tcp_flexis_cwnd_event, 
 		.cong_avoid = tcp_flexis_cong_avoid, 
+		.in_ack_event = tcp_flexis_in_ack_event, 
 		.pkts_acked = tcp_flexis_pkts_acked, 
 		.release = tcp_flexis_release, 
 		.owner = THIS_MODULE,
 		.name = "flexis"
 };
 
+// stopping module parameter writes from reaching init_net before its flexis_net goes away
+static void tcp_flexis_profiles_release(void)
+{
+	kernel_param_lock(THIS_MODULE);
+	profiles_ready = false;
+	kernel_param_unlock(THIS_MODULE);
+	unregister_pernet_subsys(&flexis_net_ops);
+}
+
 static int __init tcp_flexis_register(void)
 {
+	int ret;
+
 	BUILD_BUG_ON(sizeof(struct flexis) > ICSK_CA_PRIV_SIZE);
-	return tcp_register_congestion_control(&tcp_flexis);
+
+	ret = register_pernet_subsys(&flexis_net_ops);
+	if (ret) {
+		return ret;
+	}
+	kernel_param_lock(THIS_MODULE);
+	profiles_ready = true;
+	kernel_param_unlock(THIS_MODULE);
+
+	ret = tcp_register_congestion_control(&tcp_flexis);
+	if (ret) {
+		tcp_flexis_profiles_release();
+	}
+
+	return ret;
 }
 
 static void __exit tcp_flexis_unregister(void)
 {
 	tcp_unregister_congestion_control(&tcp_flexis);
+	tcp_flexis_profiles_release();
 }
 
 module_init(tcp_flexis_register);
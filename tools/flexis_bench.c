@@ -0,0 +1,446 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Replays an RTT trace through tcp_flexis.c once per trend estimator and compares the cost of each estimator
+ * and its congestion detections against Theil-Sen.
+ *
+ * A trace has one ACK per line: "<time_us> <rtt_us>", e.g. extracted from a capture or from ss -ti.
+ * The replay is open loop, so every estimator sees exactly the same RTT samples.
+ * Without a trace, a synthetic one is generated: a queue that builds up and drains periodically, plus noise.
+ *
+ * With -d, every estimator is replayed a second time with the congestion decisions deferred by the given number
+ * of us. The time spent on the ACK path and in the deferred decision work, which both run in softirq context, is
+ * reported separately and in total, and the deferred detections are matched against those made on the ACK path.
+ * After every run of the deferred work, the slopes are checked against the fanout entries of rtt_sack, and a
+ * mismatch fails the run. -b sets defer_batch, so that the trend is only estimated at the last point of a batch.
+ *
+ * With -l, a loss is injected every given number of ACKs with loss_mode 1, and the number of increase epochs
+ * started is reported. Losses in the quiet part of the synthetic trace are non-congestive, so each is followed
+ * by a new epoch. A deferred replay that starts less than half the epochs of the inline one fails the run.
+ *
+ * With -c, it instead benchmarks the cwnd and pacing ratio update of an ACK against the closed form
+ * evaluation of the rate curve that tcp_flexis.c used before its incremental curve engine, and checks that
+ * both produce the same cwnd and pacing ratio.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "flexis_glue.h"
+
+#define NR_ESTIMATORS 2
+
+static const char * const est_names[NR_ESTIMATORS] = { "theil-sen", "ols" };
+
+struct sample {
+	u64 time_us;
+	s32 rtt_us;
+};
+
+struct trace {
+	struct sample *samples;
+	size_t cnt;
+};
+
+/*
+ * the outcome of replaying a trace with one estimator
+ * @detections: the times congestion was detected, in us
+ * @ns: the wall clock time spent in tcp_flexis.c on the ACK path
+ * @defer_ns: the wall clock time spent in the deferred decision work
+ * @mem_peak: the peak number of bytes allocated by tcp_flexis.c
+ * @epochs: the number of increase epochs started
+ * @bad_slopes: the number of runs of the deferred work after which the slopes did not match rtt_sack
+ */
+struct result {
+	u64 *detections;
+	size_t cnt;
+	size_t epochs;
+	size_t bad_slopes;
+	u64 ns;
+	u64 defer_ns;
+	long mem_peak;
+};
+
+static u64 rnd_state = 88172645463325252ULL;
+
+static u64 rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int trace_load(struct trace *trace, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	size_t cap = 1 << 16;
+	unsigned long long t;
+	long rtt;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	trace->samples = malloc(cap * sizeof(struct sample));
+	trace->cnt = 0;
+	while (trace->samples && fscanf(f, "%llu %ld", &t, &rtt) == 2) {
+		if (trace->cnt == cap) {
+			cap *= 2;
+			trace->samples = realloc(trace->samples, cap * sizeof(struct sample));
+			if (!trace->samples)
+				break;
+		}
+		trace->samples[trace->cnt].time_us = t;
+		trace->samples[trace->cnt].rtt_us = rtt;
+		trace->cnt++;
+	}
+	fclose(f);
+	return trace->samples ? 0 : -1;
+}
+
+// one ACK every 100 us on a 20 ms path. every 2 s a queue builds up to 30 ms in 500 ms and drains in 100 ms
+static int trace_gen(struct trace *trace, size_t cnt)
+{
+	u64 t, phase;
+	s32 queue;
+	size_t i;
+
+	trace->samples = malloc(cnt * sizeof(struct sample));
+	if (!trace->samples)
+		return -1;
+	trace->cnt = cnt;
+	for (i = 0; i < cnt; i++) {
+		t = 1000000 + i * 100;
+		phase = t % 2000000;
+		if (phase < 500000)
+			queue = phase * 30000 / 500000;
+		else if (phase < 600000)
+			queue = (600000 - phase) * 30000 / 100000;
+		else
+			queue = 0;
+		trace->samples[i].time_us = t;
+		trace->samples[i].rtt_us = 20000 + queue + rnd() % 2000;
+	}
+	return 0;
+}
+
+/*
+ * replaying the trace, with a loss every loss_every ACKs if non-zero. the recovery of a loss lasts one RTT, during
+ * which cong_avoid is not called as in TCP
+ */
+static int replay(const struct trace *trace, int est, long defer_us, size_t loss_every, struct result *res)
+{
+	struct sock sk = { 0 };
+	size_t i, cap = 1024;
+	bool pending = false;
+	u64 start, recovery = 0, t0 = 0;
+	long mem;
+
+	if (flexis_glue_sysctl_set(&init_net, "net/flexis/default", "estimator", est) ||
+	    flexis_glue_sysctl_set(&init_net, "net/flexis/default", "defer_us", defer_us))
+		return -1;
+
+	res->detections = malloc(cap * sizeof(u64));
+	if (!res->detections)
+		return -1;
+	res->cnt = 0;
+	res->epochs = 0;
+	res->bad_slopes = 0;
+	res->ns = 0;
+	res->defer_ns = 0;
+	res->mem_peak = 0;
+
+	sk.net = &init_net;
+	sk.sk_family = AF_INET;
+	sk.snd_cwnd = 10;
+	sk.snd_cwnd_clamp = 1U << 20;
+	sk.srtt_us = trace->samples[0].rtt_us << 3;
+	flexis_glue_sock_init(&sk);
+
+	for (i = 0; i < trace->cnt; i++) {
+		sk.tcp_mstamp = trace->samples[i].time_us;
+		sk.max_packets_out = sk.snd_cwnd;
+		sk.snd_nxt = i + sk.snd_cwnd;
+		sk.srtt_us = sk.srtt_us - (sk.srtt_us >> 3) + trace->samples[i].rtt_us;
+
+		start = now_ns();
+		if (loss_every && i && !(i % loss_every) && !recovery) {
+			sk.snd_ssthresh = flexis_glue_ssthresh(&sk);
+			sk.snd_cwnd = min(sk.snd_cwnd, sk.snd_ssthresh);
+			recovery = sk.tcp_mstamp + trace->samples[i].rtt_us;
+		}
+		if (recovery && sk.tcp_mstamp >= recovery) {
+			sk.snd_cwnd = sk.snd_ssthresh;
+			flexis_glue_event(&sk, CA_EVENT_COMPLETE_CWR);
+			recovery = 0;
+		}
+		if (recovery)
+			flexis_glue_acked(&sk, 1, trace->samples[i].rtt_us);
+		else
+			flexis_glue_ack(&sk, i, 1, trace->samples[i].rtt_us);
+		res->ns += now_ns() - start;
+
+		start = now_ns();
+		if (flexis_glue_defer_poll(&sk)) {
+			res->defer_ns += now_ns() - start;
+			if (!flexis_glue_slopes_check(&sk))
+				res->bad_slopes++;
+		}
+
+		if (flexis_glue_pending(&sk) && !pending) {
+			if (res->cnt == cap) {
+				cap *= 2;
+				res->detections = realloc(res->detections, cap * sizeof(u64));
+				if (!res->detections)
+					return -1;
+			}
+			res->detections[res->cnt++] = sk.tcp_mstamp;
+		}
+		pending = flexis_glue_pending(&sk);
+		// an epoch may end and the next one start on the same ACK
+		if (flexis_glue_t0(&sk) && flexis_glue_t0(&sk) != t0)
+			res->epochs++;
+		t0 = flexis_glue_t0(&sk);
+		mem = flexis_glue_mem_bytes();
+		if (mem > res->mem_peak)
+			res->mem_peak = mem;
+	}
+
+	flexis_glue_sock_release(&sk);
+	return 0;
+}
+
+/*
+ * matching the detections of res against those of ref. a detection matches the nearest unmatched
+ * reference detection within win_us
+ */
+static void compare(const char *what, const struct result *ref, const struct result *res, u64 win_us)
+{
+	size_t i, j = 0, matched = 0;
+	u64 err = 0, d;
+
+	for (i = 0; i < res->cnt; i++) {
+		while (j < ref->cnt && ref->detections[j] + win_us < res->detections[i])
+			j++;
+		if (j < ref->cnt && ref->detections[j] <= res->detections[i] + win_us) {
+			d = ref->detections[j] > res->detections[i] ? ref->detections[j] - res->detections[i] : res->detections[i] - ref->detections[j];
+			err += d;
+			matched++;
+			j++;
+		}
+	}
+
+	printf("  %s: matched %zu of %zu, missed %zu, extra %zu, mean offset %.2f ms\n", what, matched, ref->cnt,
+	       ref->cnt - matched, res->cnt - matched, matched ? (double)err / matched / 1000 : 0.0);
+}
+
+// each epoch starts with a new rate and base RTT and runs for 5 s with an ACK every 0 to 200 us
+#define EPOCH_US 5000000
+
+static void curve_sock(struct sock *sk)
+{
+	memset(sk, 0, sizeof(*sk));
+	sk->net = &init_net;
+	sk->sk_family = AF_INET;
+	sk->snd_cwnd_clamp = 1U << 20;
+	sk->srtt_us = 20000 << 3;
+	flexis_glue_sock_init(sk);
+}
+
+// running update on every ACK of the schedule "gaps", returning the elapsed ns
+static u64 curve_run(struct sock *sk, const u32 *gaps, size_t acks, void (*update)(struct sock *sk))
+{
+	u64 t, t0, start = now_ns();
+	size_t i;
+
+	for (i = 0, t = t0 = EPOCH_US; i < acks; i++) {
+		if (t - t0 >= EPOCH_US || i == 0) {
+			t0 = t;
+			sk->snd_cwnd = 10;
+			flexis_glue_epoch(sk, t0, 1000 + i % 50000, 5000 + i % 100000);
+		}
+		t += gaps[i];
+		sk->tcp_mstamp = t;
+		sk->max_packets_out = sk->snd_cwnd;
+		update(sk);
+	}
+	return now_ns() - start;
+}
+
+static int curve_bench(size_t acks)
+{
+	struct sock ref, eng;
+	u64 t, t0, ns_ref, ns_eng;
+	u32 *gaps, pr_ref, diff;
+	size_t i, mismatch = 0, max_diff = 0;
+
+	gaps = malloc(acks * sizeof(u32));
+	if (!gaps)
+		return -1;
+	for (i = 0; i < acks; i++)
+		gaps[i] = rnd() % 200;
+
+	curve_sock(&ref);
+	curve_sock(&eng);
+	ns_ref = curve_run(&ref, gaps, acks, flexis_glue_increase_closed_form);
+	ns_eng = curve_run(&eng, gaps, acks, flexis_glue_increase);
+
+	// checking the engine against the closed form ACK by ACK
+	for (i = 0, t = t0 = EPOCH_US; i < acks; i++) {
+		if (t - t0 >= EPOCH_US || i == 0) {
+			t0 = t;
+			ref.snd_cwnd = eng.snd_cwnd = 10;
+			flexis_glue_epoch(&ref, t0, 1000 + i % 50000, 5000 + i % 100000);
+			flexis_glue_epoch(&eng, t0, 1000 + i % 50000, 5000 + i % 100000);
+		}
+		t += gaps[i];
+		ref.tcp_mstamp = eng.tcp_mstamp = t;
+		ref.max_packets_out = ref.snd_cwnd;
+		eng.max_packets_out = eng.snd_cwnd;
+		flexis_glue_increase_closed_form(&ref);
+		pr_ref = init_net.ipv4.sysctl_tcp_pacing_ca_ratio;
+		flexis_glue_increase(&eng);
+		if (ref.snd_cwnd != eng.snd_cwnd || pr_ref != (u32)init_net.ipv4.sysctl_tcp_pacing_ca_ratio) {
+			mismatch++;
+			diff = ref.snd_cwnd > eng.snd_cwnd ? ref.snd_cwnd - eng.snd_cwnd : eng.snd_cwnd - ref.snd_cwnd;
+			if (diff > max_diff)
+				max_diff = diff;
+		}
+	}
+	flexis_glue_sock_release(&ref);
+	flexis_glue_sock_release(&eng);
+
+	printf("closed form %6.1f ns/ack\n", (double)ns_ref / acks);
+	printf("engine      %6.1f ns/ack\n", (double)ns_eng / acks);
+	printf("%zu of %zu acks differ in cwnd or pacing ratio, max cwnd difference %zu\n", mismatch, acks, max_diff);
+	free(gaps);
+	return mismatch ? 1 : 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t trace] [-n acks] [-w match_ms] [-d defer_us] [-b] [-l loss_every] [-c]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct result res[NR_ESTIMATORS], def;
+	struct trace trace = { 0 };
+	const char *path = NULL;
+	size_t acks = 2000000, loss_every = 0;
+	u64 win_us = 50000;
+	bool curve = false, batch = false;
+	long defer_us = 0;
+	int opt, i, ret = 0;
+
+	while ((opt = getopt(argc, argv, "t:n:w:d:l:bch")) != -1) {
+		switch (opt) {
+		case 'b':
+			batch = true;
+			break;
+		case 'l':
+			loss_every = strtoull(optarg, NULL, 0);
+			break;
+		case 'd':
+			defer_us = strtol(optarg, NULL, 0);
+			break;
+		case 'c':
+			curve = true;
+			break;
+		case 't':
+			path = optarg;
+			break;
+		case 'n':
+			acks = strtoull(optarg, NULL, 0);
+			break;
+		case 'w':
+			win_us = strtoull(optarg, NULL, 0) * 1000;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (curve) {
+		if (flexis_glue_init())
+			return 1;
+		i = curve_bench(acks);
+		flexis_glue_exit();
+		return i;
+	}
+
+	if (path ? trace_load(&trace, path) : trace_gen(&trace, acks))
+		return 1;
+	if (!trace.cnt) {
+		fprintf(stderr, "empty trace\n");
+		return 1;
+	}
+	if (flexis_glue_init())
+		return 1;
+
+	if (flexis_glue_sysctl_set(&init_net, "net/flexis/default", "defer_us", defer_us)) {
+		fprintf(stderr, "invalid defer_us %ld\n", defer_us);
+		return 1;
+	}
+	if (loss_every && flexis_glue_sysctl_set(&init_net, "net/flexis/default", "loss_mode", 1))
+		return 1;
+	if (batch && flexis_glue_sysctl_set(&init_net, "net/flexis/default", "defer_batch", 1))
+		return 1;
+
+	printf("%zu acks over %.1f s\n", trace.cnt, (trace.samples[trace.cnt - 1].time_us - trace.samples[0].time_us) / 1e6);
+	for (i = 0; i < NR_ESTIMATORS; i++) {
+		if (replay(&trace, i, 0, loss_every, &res[i])) {
+			fprintf(stderr, "replay with %s failed\n", est_names[i]);
+			return 1;
+		}
+		printf("%-10s %8.1f ns/ack  %6zu detections  %6zu epochs  peak %ld bytes\n", est_names[i],
+		       (double)res[i].ns / trace.cnt, res[i].cnt, res[i].epochs, res[i].mem_peak);
+		if (i)
+			compare("vs theil-sen", &res[0], &res[i], win_us);
+		if (!defer_us)
+			continue;
+		if (replay(&trace, i, defer_us, loss_every, &def)) {
+			fprintf(stderr, "deferred replay with %s failed\n", est_names[i]);
+			return 1;
+		}
+		printf("  deferred  %8.1f ns/ack on the ACK path + %.1f ns/ack deferred = %.1f ns/ack in softirq, %.0f%% of inline\n",
+		       (double)def.ns / trace.cnt, (double)def.defer_ns / trace.cnt, (double)(def.ns + def.defer_ns) / trace.cnt,
+		       100.0 * (def.ns + def.defer_ns) / res[i].ns);
+		printf("            %6zu detections  %6zu epochs  peak %ld bytes\n", def.cnt, def.epochs, def.mem_peak);
+		compare("deferred vs inline", &res[i], &def, win_us);
+		if (def.bad_slopes) {
+			printf("  the slopes did not match rtt_sack after %zu runs of the deferred work\n", def.bad_slopes);
+			ret = 1;
+		}
+		if (def.epochs * 2 < res[i].epochs) {
+			printf("  deferred decisions stall the increase epochs\n");
+			ret = 1;
+		}
+		free(def.detections);
+	}
+
+	for (i = 0; i < NR_ESTIMATORS; i++)
+		free(res[i].detections);
+	free(trace.samples);
+	flexis_glue_exit();
+	return ret;
+}
@@ -0,0 +1,251 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compiles tcp_flexis.c unchanged against the kernel shim and exposes it to the userspace tools through flexis_glue.h
+ */
+#include "../tcp_flexis.c"
+#include "flexis_glue.h"
+
+struct pernet_operations *kshim_pernet_ops;
+struct tcp_congestion_ops *kshim_ca_ops;
+struct net init_net;
+
+int kshim_module_init(void);
+void kshim_module_exit(void);
+
+int flexis_glue_init(void)
+{
+	int ret = kshim_module_init();
+
+	if (ret)
+		return ret;
+	return flexis_glue_net_init(&init_net);
+}
+
+void flexis_glue_exit(void)
+{
+	flexis_glue_net_exit(&init_net);
+	kshim_module_exit();
+}
+
+int flexis_glue_net_init(struct net *net)
+{
+	net->ipv4.sysctl_tcp_pacing_ss_ratio = 200;
+	net->ipv4.sysctl_tcp_pacing_ca_ratio = 120;
+	net->gen = calloc(1, kshim_pernet_ops->size);
+	if (!net->gen)
+		return -ENOMEM;
+	return kshim_pernet_ops->init(net);
+}
+
+void flexis_glue_net_exit(struct net *net)
+{
+	kshim_pernet_ops->exit(net);
+	free(net->gen);
+	net->gen = NULL;
+}
+
+// looking up the sysctl "path/name" registered by tcp_flexis.c in the namespace
+static struct ctl_table *glue_sysctl_find(struct net *net, const char *path, const char *name)
+{
+	struct flexis_net *fn = net_generic(net, flexis_net_id);
+	struct ctl_table_header *hdr;
+	size_t i, j;
+
+	for (i = 0; i < ARRAY_SIZE(fn->hdrs); i++) {
+		hdr = fn->hdrs[i];
+		if (!hdr || strcmp(hdr->path, path))
+			continue;
+		for (j = 0; j < hdr->size; j++) {
+			if (!strcmp(hdr->ctl_table_arg[j].procname, name))
+				return &hdr->ctl_table_arg[j];
+		}
+	}
+	return NULL;
+}
+
+int flexis_glue_sysctl_set(struct net *net, const char *path, const char *name, long val)
+{
+	struct ctl_table *table = glue_sysctl_find(net, path, name);
+
+	if (!table || !(table->mode & 0200))
+		return -ENOENT;
+	if ((table->extra1 && val < *(int *)table->extra1) || (table->extra2 && val > *(int *)table->extra2))
+		return -EINVAL;
+	if (table->maxlen == sizeof(long))
+		*(long *)table->data = val;
+	else
+		*(int *)table->data = val;
+	return 0;
+}
+
+int flexis_glue_sysctl_get(struct net *net, const char *path, const char *name, long *val)
+{
+	struct ctl_table *table = glue_sysctl_find(net, path, name);
+
+	if (!table)
+		return -ENOENT;
+	if (table->maxlen == sizeof(long))
+		*val = *(long *)table->data;
+	else
+		*val = *(int *)table->data;
+	return 0;
+}
+
+void flexis_glue_sock_init(struct sock *sk)
+{
+	kshim_ca_ops->init(sk);
+}
+
+void flexis_glue_sock_release(struct sock *sk)
+{
+	kshim_ca_ops->release(sk);
+}
+
+void flexis_glue_ack(struct sock *sk, u32 ack, u32 acked, s32 rtt_us)
+{
+	struct ack_sample sample = { .pkts_acked = acked, .rtt_us = rtt_us };
+
+	kshim_ca_ops->pkts_acked(sk, &sample);
+	kshim_ca_ops->cong_avoid(sk, ack, acked);
+}
+
+void flexis_glue_acked(struct sock *sk, u32 acked, s32 rtt_us)
+{
+	struct ack_sample sample = { .pkts_acked = acked, .rtt_us = rtt_us };
+
+	kshim_ca_ops->pkts_acked(sk, &sample);
+}
+
+void flexis_glue_cong_avoid(struct sock *sk, u32 ack, u32 acked)
+{
+	kshim_ca_ops->cong_avoid(sk, ack, acked);
+}
+
+u32 flexis_glue_ssthresh(struct sock *sk)
+{
+	return kshim_ca_ops->ssthresh(sk);
+}
+
+void flexis_glue_event(struct sock *sk, enum tcp_ca_event ev)
+{
+	kshim_ca_ops->cwnd_event(sk, ev);
+}
+
+u32 flexis_glue_undo(struct sock *sk)
+{
+	return kshim_ca_ops->undo_cwnd(sk);
+}
+
+bool flexis_glue_pending(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+
+	return flexis->vars && flexis->vars->snd_nxt;
+}
+
+void flexis_glue_epoch(struct sock *sk, u64 t0, u32 r0, u32 min_rtt_us)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+
+	flexis->vars->t0 = t0;
+	flexis->vars->r0 = r0;
+	flexis->vars->t_ulmt = 0;
+	minmax_reset(&flexis->vars->base_rtt, t0 / USEC_PER_MSEC, min_rtt_us);
+	minmax_reset(&flexis->vars->recent_rtt, t0 / USEC_PER_MSEC, min_rtt_us);
+	curve_reset(sk);
+}
+
+u64 flexis_glue_t0(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+
+	return flexis->vars ? flexis->vars->t0 : 0;
+}
+
+void flexis_glue_increase(struct sock *sk)
+{
+	increase_cwnd(sk);
+}
+
+// increase_cwnd as it was before the rate curve engine: the closed form of the curve on every ACK
+void flexis_glue_increase_closed_form(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct flexis *flexis = inet_csk_ca(sk);
+	long t1, t2;
+	u64 r1, r2, rem;
+	u32 pr, rtt;
+
+	if (!flexis->vars->t0 || !is_cwnd_limited(sk) || !flexis->vars->p.alpha || !flexis->vars->p.beta)
+		return;
+	rtt = base_rtt(sk);
+	t1 = tp->tcp_mstamp - flexis->vars->t0;
+	if (t1 < 0)
+		return;
+	r1 = int_pow(t1 / USEC_PER_MSEC / flexis->vars->p.alpha, 3) + t1 / USEC_PER_MSEC / flexis->vars->p.beta + flexis->vars->r0;
+	if (!r1)
+		return;
+	tp->snd_cwnd = max(tp->snd_cwnd, min_t(u32, div_u64(r1 * rtt, (u32)USEC_PER_SEC), tp->snd_cwnd_clamp));
+	flexis->vars->undo_cwnd = tp->snd_cwnd;
+	t2 = t1 + rtt;
+	r2 = int_pow(t2 / USEC_PER_MSEC / flexis->vars->p.alpha, 3) + t2 / USEC_PER_MSEC / flexis->vars->p.beta + flexis->vars->r0;
+	pr = div64_u64_rem(r2 * 100, r1, &rem);
+	if (rem)
+		pr++;
+	update_pacing_ratio(sk, pr);
+}
+
+bool flexis_glue_defer_poll(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct hrtimer *timer;
+
+	if (!flexis->vars || !flexis->vars->defer)
+		return false;
+	timer = &flexis->vars->defer->timer;
+	if (!timer->queued)
+		return false;
+	if (!timer->expires_us)
+		timer->expires_us = sk->tcp_mstamp + timer->delay / NSEC_PER_USEC;
+	if (sk->tcp_mstamp < timer->expires_us)
+		return false;
+	timer->queued = false;
+	timer->expires_us = 0;
+	if (timer->function(timer) == HRTIMER_RESTART)
+		timer->queued = true;
+	return true;
+}
+
+bool flexis_glue_slopes_check(struct sock *sk)
+{
+	struct flexis *flexis = inet_csk_ca(sk);
+	struct list_head *pos;
+	struct pnode *pnode;
+	u32 listed = 0, refs = 0;
+
+	if (!flexis->vars)
+		return true;
+	list_for_each(pos, &flexis->slopes.head)
+		listed++;
+	list_for_each(pos, &flexis->vars->batch)
+		listed++;
+	list_for_each_entry(pnode, &flexis->rtt_sack.head, links) {
+		list_for_each(pos, &pnode->fanout_head)
+			refs++;
+	}
+	return listed == flexis->slopes.cnt && refs == flexis->slopes.cnt;
+}
+
+long flexis_glue_mem_bytes(void)
+{
+	return atomic_long_read(&mem_bytes);
+}
@@ -0,0 +1,63 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FLEXIS_GLUE_H
+#define FLEXIS_GLUE_H
+
+#include "kshim.h"
+
+// registering the congestion control and initializing init_net
+int flexis_glue_init(void);
+void flexis_glue_exit(void);
+// creating and destroying the flexis state of a network namespace
+int flexis_glue_net_init(struct net *net);
+void flexis_glue_net_exit(struct net *net);
+/*
+ * writing and reading the sysctl /proc/sys/<path>/<name> of a namespace, e.g. ("net/flexis/default", "alpha").
+ * the host wide entries only exist in init_net
+ */
+int flexis_glue_sysctl_set(struct net *net, const char *path, const char *name, long val);
+int flexis_glue_sysctl_get(struct net *net, const char *path, const char *name, long *val);
+
+void flexis_glue_sock_init(struct sock *sk);
+void flexis_glue_sock_release(struct sock *sk);
+// delivering an ACK that acknowledges "acked" packets up to "ack" with an RTT sample of rtt_us
+void flexis_glue_ack(struct sock *sk, u32 ack, u32 acked, s32 rtt_us);
+// the two halves of flexis_glue_ack, TCP only runs the first one during loss recovery
+void flexis_glue_acked(struct sock *sk, u32 acked, s32 rtt_us);
+void flexis_glue_cong_avoid(struct sock *sk, u32 ack, u32 acked);
+u32 flexis_glue_ssthresh(struct sock *sk);
+void flexis_glue_event(struct sock *sk, enum tcp_ca_event ev);
+u32 flexis_glue_undo(struct sock *sk);
+// whether flexis has reduced cwnd and waits for the first segment sent after the reduction
+bool flexis_glue_pending(struct sock *sk);
+// starting an increase epoch at t0 with the initial rate r0 and the base RTT min_rtt_us
+void flexis_glue_epoch(struct sock *sk, u64 t0, u32 r0, u32 min_rtt_us);
+// the start time of the current increase epoch, 0 if none has started since the last decrease
+u64 flexis_glue_t0(struct sock *sk);
+// running only the cwnd and pacing ratio update of an ACK
+void flexis_glue_increase(struct sock *sk);
+// the same update evaluating the closed form of the rate curve, as tcp_flexis.c did before its curve engine
+void flexis_glue_increase_closed_form(struct sock *sk);
+/*
+ * running the deferred decision work of the socket if its timer was started at least defer_us before tcp_mstamp.
+ * the start time is taken as the tcp_mstamp of the first call after the timer was started, so call it after every ACK.
+ * returns whether the work ran
+ */
+bool flexis_glue_defer_poll(struct sock *sk);
+/*
+ * whether every slope of the socket is in slopes or in the batch of the deferred work, is counted in slopes.cnt and is
+ * referenced by one fanout entry of a point of rtt_sack
+ */
+bool flexis_glue_slopes_check(struct sock *sk);
+// the bytes allocated by all sockets
+long flexis_glue_mem_bytes(void);
+
+#endif
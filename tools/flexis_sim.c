@@ -0,0 +1,1279 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Simulates FlexiS flows sharing a bottleneck, for sweeps over the parameters of tcp_flexis.c and of the path.
+ *
+ * A scenario is a list of key=value assignments. The model keys below describe the path, every other key is a
+ * sysctl of the scenario's network namespace: "alpha" is net/flexis/default/alpha, "coupled" is net/flexis/coupled
+ * and "bulk/tau" is net/flexis/bulk/tau. A value may be a comma separated list, a scenario is then run for every
+ * combination of the values of its keys.
+ *
+ * The model is a discrete-event simulation of bulk flows through one drop-tail FIFO queue. A packet of a flow reaches
+ * the queue after half its base RTT and its ACK reaches the sender half the base RTT after it leaves the queue. Every
+ * packet is acknowledged on its own, like with SACK, and a packet is lost once a packet sent after it is acknowledged,
+ * since the queue serves the packets of a flow in order. The sender follows Linux: fast recovery reduces cwnd to
+ * ssthresh, an RTO sets it to 1, cong_avoid is not called during recovery and packets are paced at the pacing ratio.
+ * Cross traffic is a Poisson stream of unresponsive packets, optionally switched on and off after exponentially
+ * distributed periods.
+ *
+ * The scenarios are run on a work stealing pool of threads, each scenario with its own network namespace and a
+ * random seed derived from -S and its position, so the results do not depend on the number of threads. They are
+ * printed one line per run, in the order of the scenarios.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <ctype.h>
+#include <limits.h>
+#include "flexis_glue.h"
+
+// the maximum number of flows of a scenario and of entries of a per flow list
+#define MAX_FLOWS 1024
+#define MAX_LIST 64
+// the maximum number of sequences between snd_una and snd_nxt of a flow
+#define SEQ_WIN_MAX (1U << 22)
+#define INIT_CWND 10
+#define RTO_INIT_NS (1000 * NSEC_PER_MSEC)
+#define RTO_MIN_NS (200 * NSEC_PER_MSEC)
+#define RTO_MAX_NS (60000 * NSEC_PER_MSEC)
+// the queueing delay histogram has QDELAY_BINS bins of QDELAY_BIN_NS
+#define QDELAY_BIN_NS (100 * NSEC_PER_USEC)
+#define QDELAY_BINS 10000
+// the initial ssthresh of Linux
+#define TCP_INFINITE_SSTHRESH 0x7fffffff
+// tcp_mstamp at the start of a simulation, tcp_flexis.c takes 0 as no time
+#define CLOCK_BASE_US USEC_PER_SEC
+
+/*
+ * the parameters of a scenario
+ * @capacity: the rate of the bottleneck in Mbit/s
+ * @buffer: the size of the queue in packets, 0 for one BDP at the base RTT of the first flow
+ * @rtt: the base RTTs of the flows in ms, flow i has rtt[i % nr_rtt]
+ * @start: the start times of the flows in s, flow i starts at start[i % nr_start]
+ * @cross: the mean rate of the cross traffic in Mbit/s while it is on
+ * @cross_on, @cross_off: the mean on and off periods of the cross traffic in ms, 0 for always on
+ * @loss: the probability in percent that a packet of a flow is lost before the queue
+ * @warmup: the time in s before the throughput, delay and fairness are measured
+ * @knobs: the sysctls of the network namespace of the scenario
+ * @desc: the assignments of the scenario, as printed
+ */
+struct scenario {
+	double capacity;
+	u32 buffer;
+	u32 flows;
+	double rtt[MAX_LIST];
+	u32 nr_rtt;
+	double start[MAX_LIST];
+	u32 nr_start;
+	double cross;
+	double cross_on;
+	double cross_off;
+	double loss;
+	double duration;
+	double warmup;
+	u32 mss;
+	struct knob {
+		char path[64];
+		char name[32];
+		long val;
+	} *knobs;
+	u32 nr_knobs;
+	char *desc;
+};
+
+enum key_kind { KEY_DOUBLE, KEY_U32, KEY_LIST };
+
+static const struct model_key {
+	const char *name;
+	enum key_kind kind;
+	size_t off;
+	size_t cnt_off;
+} model_keys[] = {
+	{ "capacity", KEY_DOUBLE, offsetof(struct scenario, capacity) },
+	{ "buffer", KEY_U32, offsetof(struct scenario, buffer) },
+	{ "flows", KEY_U32, offsetof(struct scenario, flows) },
+	{ "rtt", KEY_LIST, offsetof(struct scenario, rtt), offsetof(struct scenario, nr_rtt) },
+	{ "start", KEY_LIST, offsetof(struct scenario, start), offsetof(struct scenario, nr_start) },
+	{ "cross", KEY_DOUBLE, offsetof(struct scenario, cross) },
+	{ "cross_on", KEY_DOUBLE, offsetof(struct scenario, cross_on) },
+	{ "cross_off", KEY_DOUBLE, offsetof(struct scenario, cross_off) },
+	{ "loss", KEY_DOUBLE, offsetof(struct scenario, loss) },
+	{ "duration", KEY_DOUBLE, offsetof(struct scenario, duration) },
+	{ "warmup", KEY_DOUBLE, offsetof(struct scenario, warmup) },
+	{ "mss", KEY_U32, offsetof(struct scenario, mss) },
+};
+
+// a key with the list of values it is swept over
+struct assign {
+	char *key;
+	char *buf;
+	char **vals;
+	u32 nr;
+};
+
+// a growable ring of T, the capacity is a power of 2
+#define RING(T) struct { T *buf; u32 head; u32 cnt; u32 cap; }
+#define ring_at(r, i) ((r)->buf[((r)->head + (i)) & ((r)->cap - 1)])
+#define ring_reserve(r) ((r)->cnt == (r)->cap ? \
+			 ring_resize((void **)&(r)->buf, &(r)->head, (r)->cnt, &(r)->cap, sizeof(*(r)->buf)) : 0)
+#define ring_pop(r) ((r)->head++, (r)->cnt--)
+
+enum ev_type {
+	EV_START,
+	EV_SEND,
+	EV_ARRIVE,
+	EV_ACK,
+	EV_RTO,
+	EV_CROSS,
+	EV_CROSS_TOGGLE,
+};
+
+/*
+ * an event, events at the same time run in the order they were scheduled
+ * @tx: the transmission number of the packet of EV_ARRIVE and EV_ACK
+ * @seq: the sequence of that packet, or the generation of the cross traffic of EV_CROSS
+ */
+struct ev {
+	u64 time_ns;
+	u64 id;
+	u64 tx;
+	u32 seq;
+	u32 flow;
+	enum ev_type type;
+};
+
+// a packet sent and not acknowledged yet
+struct tx {
+	u32 seq;
+	bool retrans;
+	u64 sent_ns;
+};
+
+/*
+ * a bulk flow, sequences count packets from 1
+ * @delivered: whether the sequences from snd_una to snd_nxt were delivered, indexed by seq & (delivered_cap - 1)
+ * @txs: the packets in flight in the order they were sent, the first one is transmission tx_una
+ * @rtx: the sequences found lost and not retransmitted yet
+ * @high_seq: snd_nxt when fast recovery started, recovery ends once it is acknowledged
+ * @rto_ns: when the retransmission timer expires, 0 if it is not running
+ * @pending: whether flexis was waiting for the end of a decrease at the last ACK
+ */
+struct flow {
+	struct sock sk;
+	u64 rtt_ns;
+	u64 start_ns;
+	u32 snd_una;
+	u32 snd_nxt;
+	u8 *delivered;
+	u32 delivered_cap;
+	RING(struct tx) txs;
+	u64 tx_una;
+	RING(u32) rtx;
+	u64 next_send_ns;
+	bool send_queued;
+	bool recovery;
+	u32 high_seq;
+	u32 cwnd_usage_seq;
+	u32 rttvar_us;
+	u64 rto_ns;
+	bool rto_queued;
+	u32 backoff;
+	bool pending;
+	u64 sent;
+	u64 lost;
+	u64 bytes;
+	u64 decs;
+	u64 timeouts;
+};
+
+struct sim {
+	const struct scenario *sc;
+	struct net net;
+	struct flow *flows;
+	struct ev *heap;
+	size_t nr_evs;
+	size_t cap_evs;
+	u64 next_id;
+	u64 rng;
+	u64 now_ns;
+	u64 end_ns;
+	u64 warmup_ns;
+	// the bottleneck, its queue is the time its last accepted packet leaves it minus now
+	u64 bps;
+	u64 svc_ns;
+	u64 buffer_ns;
+	u64 last_dep_ns;
+	u64 link_bytes;
+	u64 qdelay_sum_ns;
+	u64 qdelay_cnt;
+	u32 *qdelay_hist;
+	bool cross_on;
+	u32 cross_gen;
+	double cross_gap_ns;
+	u64 events;
+};
+
+/*
+ * the outcome of a run
+ * @tput: the throughput of all flows in Mbit/s
+ * @util: the utilization of the bottleneck in percent, including the cross traffic
+ * @jain: Jain's fairness index of the throughputs of the flows
+ * @flow_tput: the throughput of every flow in Mbit/s
+ */
+struct result {
+	u64 seed;
+	double tput;
+	double util;
+	double qdelay_ms;
+	double qdelay_p95_ms;
+	double loss;
+	double jain;
+	u64 decs;
+	u64 timeouts;
+	double *flow_tput;
+	u64 events;
+	int err;
+	bool done;
+};
+
+// the tasks of a worker, the owner takes them from the bottom and the other workers steal them from the top
+struct deque {
+	pthread_mutex_t lock;
+	u32 *tasks;
+	u32 top;
+	u32 bottom;
+};
+
+struct pool;
+
+struct worker {
+	pthread_t thread;
+	struct pool *pool;
+	struct deque dq;
+	u64 rng;
+	u64 steals;
+	u64 events;
+};
+
+/*
+ * task i is run i % runs of scenario i / runs
+ * @next_print: the first task whose result is not printed yet
+ */
+struct pool {
+	const struct scenario *scenarios;
+	u32 runs;
+	u32 nr_tasks;
+	u64 seed;
+	bool per_flow;
+	struct worker *workers;
+	int nr_workers;
+	struct result *results;
+	pthread_mutex_t print_lock;
+	u32 next_print;
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline bool seq_before(u32 a, u32 b)
+{
+	return (s32)(a - b) < 0;
+}
+
+// splitmix64
+static u64 rng_next(u64 *s)
+{
+	u64 z = (*s += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static double rng_unit(u64 *s)
+{
+	return (rng_next(s) >> 11) * 0x1.0p-53;
+}
+
+static u64 rng_exp(u64 *s, double mean)
+{
+	return -log(1 - rng_unit(s)) * mean;
+}
+
+static int ring_resize(void **buf, u32 *head, u32 cnt, u32 *cap, size_t size)
+{
+	u32 new_cap = *cap ? *cap * 2 : 16, i;
+	char *new_buf = malloc(new_cap * size);
+
+	if (!new_buf)
+		return -1;
+	for (i = 0; i < cnt; i++)
+		memcpy(new_buf + i * size, (char *)*buf + ((*head + i) & (*cap - 1)) * size, size);
+	free(*buf);
+	*buf = new_buf;
+	*head = 0;
+	*cap = new_cap;
+	return 0;
+}
+
+static int sim_push(struct sim *sim, u64 time_ns, enum ev_type type, u32 flow, u64 tx, u32 seq)
+{
+	struct ev ev = { .time_ns = time_ns, .id = sim->next_id++, .tx = tx, .seq = seq, .flow = flow, .type = type };
+	size_t i = sim->nr_evs, parent;
+	struct ev *heap;
+
+	if (sim->nr_evs == sim->cap_evs) {
+		heap = realloc(sim->heap, (sim->cap_evs ? sim->cap_evs * 2 : 1024) * sizeof(*heap));
+		if (!heap)
+			return -ENOMEM;
+		sim->heap = heap;
+		sim->cap_evs = sim->cap_evs ? sim->cap_evs * 2 : 1024;
+	}
+	for (; i; i = parent) {
+		parent = (i - 1) / 2;
+		if (sim->heap[parent].time_ns < ev.time_ns ||
+		    (sim->heap[parent].time_ns == ev.time_ns && sim->heap[parent].id < ev.id))
+			break;
+		sim->heap[i] = sim->heap[parent];
+	}
+	sim->heap[i] = ev;
+	sim->nr_evs++;
+	return 0;
+}
+
+static inline bool ev_before(const struct ev *a, const struct ev *b)
+{
+	return a->time_ns < b->time_ns || (a->time_ns == b->time_ns && a->id < b->id);
+}
+
+static void sim_pop(struct sim *sim, struct ev *ev)
+{
+	struct ev last = sim->heap[--sim->nr_evs];
+	size_t i = 0, child;
+
+	*ev = sim->heap[0];
+	for (; (child = 2 * i + 1) < sim->nr_evs; i = child) {
+		if (child + 1 < sim->nr_evs && ev_before(&sim->heap[child + 1], &sim->heap[child]))
+			child++;
+		if (!ev_before(&sim->heap[child], &last))
+			break;
+		sim->heap[i] = sim->heap[child];
+	}
+	sim->heap[i] = last;
+}
+
+static inline u64 sim_mstamp(const struct sim *sim)
+{
+	return CLOCK_BASE_US + sim->now_ns / NSEC_PER_USEC;
+}
+
+static inline bool sim_measuring(const struct sim *sim, u64 time_ns)
+{
+	return time_ns >= sim->warmup_ns && time_ns < sim->end_ns;
+}
+
+/*
+ * queueing a packet at the bottleneck, returning false if the queue is full. *dep_ns is the time the packet leaves
+ * the bottleneck
+ */
+static bool link_enqueue(struct sim *sim, u64 *dep_ns)
+{
+	u64 q = sim->last_dep_ns > sim->now_ns ? sim->last_dep_ns - sim->now_ns : 0;
+
+	if (q + sim->svc_ns > sim->buffer_ns)
+		return false;
+	*dep_ns = sim->now_ns + q + sim->svc_ns;
+	sim->last_dep_ns = *dep_ns;
+	if (sim_measuring(sim, sim->now_ns)) {
+		sim->qdelay_sum_ns += q;
+		sim->qdelay_cnt++;
+		sim->qdelay_hist[min_t(u64, q / QDELAY_BIN_NS, QDELAY_BINS - 1)]++;
+	}
+	if (sim_measuring(sim, *dep_ns))
+		sim->link_bytes += sim->sc->mss;
+	return true;
+}
+
+static inline bool flow_delivered(const struct flow *f, u32 seq)
+{
+	return seq_before(seq, f->snd_una) || f->delivered[seq & (f->delivered_cap - 1)];
+}
+
+// making room for one more sequence between snd_una and snd_nxt
+static int flow_seq_reserve(struct flow *f)
+{
+	u32 cap = f->delivered_cap ? f->delivered_cap * 2 : 1024, seq;
+	u8 *delivered;
+
+	if (f->snd_nxt - f->snd_una < f->delivered_cap)
+		return 0;
+	delivered = calloc(cap, 1);
+	if (!delivered)
+		return -ENOMEM;
+	for (seq = f->snd_una; seq != f->snd_nxt; seq++)
+		delivered[seq & (cap - 1)] = f->delivered[seq & (f->delivered_cap - 1)];
+	free(f->delivered);
+	f->delivered = delivered;
+	f->delivered_cap = cap;
+	return 0;
+}
+
+static u64 flow_rto_ns(const struct flow *f)
+{
+	u64 rto = RTO_INIT_NS;
+
+	if (f->sk.srtt_us)
+		rto = max_t(u64, ((f->sk.srtt_us >> 3) + 4 * f->rttvar_us) * NSEC_PER_USEC, RTO_MIN_NS);
+	return min_t(u64, rto << min_t(u32, f->backoff, 16), RTO_MAX_NS);
+}
+
+static int flow_rto_arm(struct sim *sim, struct flow *f)
+{
+	f->rto_ns = sim->now_ns + flow_rto_ns(f);
+	if (f->rto_queued)
+		return 0;
+	f->rto_queued = true;
+	return sim_push(sim, f->rto_ns, EV_RTO, f - sim->flows, 0, 0);
+}
+
+// the time between two packets at the pacing rate of Linux: ratio * max(cwnd, packets in flight) / srtt
+static u64 flow_pacing_gap_ns(const struct sim *sim, const struct flow *f)
+{
+	const struct tcp_sock *tp = &f->sk;
+	u32 ratio;
+
+	if (!tp->srtt_us || tp->sk_pacing_status == SK_PACING_NONE)
+		return 0;
+	ratio = tp->snd_cwnd < tp->snd_ssthresh / 2 ? sim->net.ipv4.sysctl_tcp_pacing_ss_ratio :
+		sim->net.ipv4.sysctl_tcp_pacing_ca_ratio;
+	return div64_u64((u64)(tp->srtt_us >> 3) * NSEC_PER_USEC * 100, (u64)ratio * max(tp->snd_cwnd, f->txs.cnt));
+}
+
+// sending what cwnd and the pacing rate allow, the lost sequences first
+static int flow_send(struct sim *sim, struct flow *f)
+{
+	struct tcp_sock *tp = &f->sk;
+	u32 i = f - sim->flows, seq;
+	bool retrans;
+
+	while (f->txs.cnt < tp->snd_cwnd) {
+		if (f->next_send_ns > sim->now_ns) {
+			if (f->send_queued)
+				return 0;
+			f->send_queued = true;
+			return sim_push(sim, f->next_send_ns, EV_SEND, i, 0, 0);
+		}
+		while (f->rtx.cnt && flow_delivered(f, ring_at(&f->rtx, 0)))
+			ring_pop(&f->rtx);
+		if (f->rtx.cnt) {
+			seq = ring_at(&f->rtx, 0);
+			ring_pop(&f->rtx);
+			retrans = true;
+		} else {
+			if (f->snd_nxt - f->snd_una >= SEQ_WIN_MAX - 1)
+				return 0;
+			if (flow_seq_reserve(f))
+				return -ENOMEM;
+			seq = f->snd_nxt++;
+			retrans = false;
+		}
+		if (ring_reserve(&f->txs))
+			return -ENOMEM;
+		ring_at(&f->txs, f->txs.cnt) = (struct tx){ .seq = seq, .retrans = retrans, .sent_ns = sim->now_ns };
+		f->txs.cnt++;
+		if (sim_push(sim, sim->now_ns + f->rtt_ns / 2, EV_ARRIVE, i, f->tx_una + f->txs.cnt - 1, seq))
+			return -ENOMEM;
+		f->sent++;
+		tp->snd_nxt = f->snd_nxt;
+		// tcp_cwnd_validate
+		if (f->txs.cnt > tp->max_packets_out || !seq_before(f->snd_una, f->cwnd_usage_seq)) {
+			tp->max_packets_out = f->txs.cnt;
+			f->cwnd_usage_seq = f->snd_nxt;
+		}
+		f->next_send_ns = max(f->next_send_ns, sim->now_ns) + flow_pacing_gap_ns(sim, f);
+		if (!f->rto_ns && flow_rto_arm(sim, f))
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+static int flow_start(struct sim *sim, struct flow *f)
+{
+	struct tcp_sock *tp = &f->sk;
+
+	tp->net = &sim->net;
+	// all flows share the destination address, so net.flexis.coupled groups them
+	tp->sk_family = AF_INET;
+	tp->sk_daddr = 1;
+	tp->snd_cwnd = INIT_CWND;
+	tp->snd_cwnd_clamp = SEQ_WIN_MAX / 2;
+	tp->snd_ssthresh = TCP_INFINITE_SSTHRESH;
+	tp->tcp_mstamp = sim_mstamp(sim);
+	f->snd_una = f->snd_nxt = f->cwnd_usage_seq = 1;
+	flexis_glue_sock_init(tp);
+	return flow_send(sim, f);
+}
+
+static void flow_rtt_sample(struct flow *f, u32 rtt_us)
+{
+	struct tcp_sock *tp = &f->sk;
+	s32 err;
+
+	if (!tp->srtt_us) {
+		tp->srtt_us = rtt_us << 3;
+		f->rttvar_us = rtt_us / 2;
+		return;
+	}
+	err = rtt_us - (tp->srtt_us >> 3);
+	tp->srtt_us += err;
+	f->rttvar_us = f->rttvar_us - (f->rttvar_us >> 2) + (abs(err) >> 2);
+}
+
+static int flow_ack(struct sim *sim, struct flow *f, const struct ev *ev)
+{
+	struct tcp_sock *tp = &f->sk;
+	struct tx *t;
+	s32 rtt_us = -1;
+	u32 acked = 0, lost = 0;
+	bool pending;
+
+	tp->tcp_mstamp = sim_mstamp(sim);
+	if (ev->tx >= f->tx_una) {
+		// the packets sent before it are lost, the bottleneck serves the packets of a flow in order
+		for (; f->tx_una < ev->tx; f->tx_una++, lost++) {
+			t = &ring_at(&f->txs, 0);
+			if (!flow_delivered(f, t->seq)) {
+				if (ring_reserve(&f->rtx))
+					return -ENOMEM;
+				ring_at(&f->rtx, f->rtx.cnt) = t->seq;
+				f->rtx.cnt++;
+			}
+			ring_pop(&f->txs);
+		}
+		t = &ring_at(&f->txs, 0);
+		if (!t->retrans)
+			rtt_us = (sim->now_ns - t->sent_ns) / NSEC_PER_USEC;
+		ring_pop(&f->txs);
+		f->tx_una++;
+	}
+	if (!flow_delivered(f, ev->seq)) {
+		f->delivered[ev->seq & (f->delivered_cap - 1)] = 1;
+		for (; f->snd_una != f->snd_nxt && f->delivered[f->snd_una & (f->delivered_cap - 1)]; f->snd_una++)
+			f->delivered[f->snd_una & (f->delivered_cap - 1)] = 0;
+		acked = 1;
+		if (sim_measuring(sim, sim->now_ns))
+			f->bytes += sim->sc->mss;
+	}
+	if (rtt_us >= 0)
+		flow_rtt_sample(f, rtt_us);
+	f->lost += lost;
+	f->backoff = 0;
+	if (!f->txs.cnt)
+		f->rto_ns = 0;
+	else if (flow_rto_arm(sim, f))
+		return -ENOMEM;
+
+	// the order of tcp_ack: tcp_clean_rtx_queue, tcp_fastretrans_alert, tcp_cong_control
+	if (acked)
+		flexis_glue_acked(tp, acked, rtt_us);
+	if (f->recovery && !seq_before(f->snd_una, f->high_seq)) {
+		tp->snd_cwnd = tp->snd_ssthresh;
+		f->recovery = false;
+		flexis_glue_event(tp, CA_EVENT_COMPLETE_CWR);
+	}
+	if (lost && !f->recovery) {
+		// the reduction of PRR is applied at once
+		tp->prior_cwnd = tp->snd_cwnd;
+		tp->snd_ssthresh = flexis_glue_ssthresh(tp);
+		tp->snd_cwnd = min(tp->snd_cwnd, tp->snd_ssthresh);
+		f->recovery = true;
+		f->high_seq = f->snd_nxt;
+	}
+	if (acked && !f->recovery)
+		flexis_glue_cong_avoid(tp, f->snd_una, acked);
+	flexis_glue_defer_poll(tp);
+
+	pending = flexis_glue_pending(tp);
+	if (pending && !f->pending && sim_measuring(sim, sim->now_ns))
+		f->decs++;
+	f->pending = pending;
+	return flow_send(sim, f);
+}
+
+static int flow_timeout(struct sim *sim, struct flow *f)
+{
+	struct tcp_sock *tp = &f->sk;
+
+	f->rto_queued = false;
+	if (!f->rto_ns)
+		return 0;
+	if (f->rto_ns > sim->now_ns) {
+		f->rto_queued = true;
+		return sim_push(sim, f->rto_ns, EV_RTO, f - sim->flows, 0, 0);
+	}
+
+	// tcp_enter_loss, every packet in flight is lost
+	tp->tcp_mstamp = sim_mstamp(sim);
+	if (!f->backoff) {
+		tp->prior_cwnd = tp->snd_cwnd;
+		tp->snd_ssthresh = flexis_glue_ssthresh(tp);
+	}
+	tp->snd_cwnd = 1;
+	for (; f->txs.cnt; f->tx_una++) {
+		if (!flow_delivered(f, ring_at(&f->txs, 0).seq)) {
+			if (ring_reserve(&f->rtx))
+				return -ENOMEM;
+			ring_at(&f->rtx, f->rtx.cnt) = ring_at(&f->txs, 0).seq;
+			f->rtx.cnt++;
+		}
+		ring_pop(&f->txs);
+		f->lost++;
+	}
+	f->recovery = false;
+	f->timeouts++;
+	flexis_glue_event(tp, CA_EVENT_LOSS);
+	f->backoff++;
+	f->rto_ns = 0;
+	f->next_send_ns = sim->now_ns;
+	return flow_send(sim, f);
+}
+
+static int sim_event(struct sim *sim, const struct ev *ev)
+{
+	const struct scenario *sc = sim->sc;
+	struct flow *f = &sim->flows[ev->flow];
+	u64 dep_ns;
+
+	switch (ev->type) {
+	case EV_START:
+		return flow_start(sim, f);
+	case EV_SEND:
+		f->send_queued = false;
+		return flow_send(sim, f);
+	case EV_ARRIVE:
+		if (sc->loss && rng_unit(&sim->rng) * 100 < sc->loss)
+			return 0;
+		if (!link_enqueue(sim, &dep_ns))
+			return 0;
+		return sim_push(sim, dep_ns + f->rtt_ns / 2, EV_ACK, ev->flow, ev->tx, ev->seq);
+	case EV_ACK:
+		return flow_ack(sim, f, ev);
+	case EV_RTO:
+		return flow_timeout(sim, f);
+	case EV_CROSS:
+		if (ev->seq != sim->cross_gen)
+			return 0;
+		link_enqueue(sim, &dep_ns);
+		return sim_push(sim, sim->now_ns + rng_exp(&sim->rng, sim->cross_gap_ns), EV_CROSS, 0, 0, sim->cross_gen);
+	case EV_CROSS_TOGGLE:
+		sim->cross_on = !sim->cross_on;
+		sim->cross_gen++;
+		if (sim->cross_on &&
+		    sim_push(sim, sim->now_ns + rng_exp(&sim->rng, sim->cross_gap_ns), EV_CROSS, 0, 0, sim->cross_gen))
+			return -ENOMEM;
+		return sim_push(sim, sim->now_ns + rng_exp(&sim->rng, (sim->cross_on ? sc->cross_on : sc->cross_off) * NSEC_PER_MSEC),
+				EV_CROSS_TOGGLE, 0, 0, 0);
+	}
+	return 0;
+}
+
+static void sim_result(struct sim *sim, struct result *res)
+{
+	const struct scenario *sc = sim->sc;
+	double secs = (sim->end_ns - sim->warmup_ns) / 1e9, sum = 0, sum2 = 0, x;
+	u64 sent = 0, lost = 0, cnt = 0;
+	u32 i;
+
+	for (i = 0; i < sc->flows; i++) {
+		x = sim->flows[i].bytes * 8 / secs / 1e6;
+		res->flow_tput[i] = x;
+		sum += x;
+		sum2 += x * x;
+		sent += sim->flows[i].sent;
+		lost += sim->flows[i].lost;
+		res->decs += sim->flows[i].decs;
+		res->timeouts += sim->flows[i].timeouts;
+	}
+	res->tput = sum;
+	res->jain = sum2 ? sum * sum / (sc->flows * sum2) : 0;
+	res->loss = sent ? 100.0 * lost / sent : 0;
+	res->util = 100 * sim->link_bytes * 8 / secs / sim->bps;
+	res->qdelay_ms = sim->qdelay_cnt ? sim->qdelay_sum_ns / 1e6 / sim->qdelay_cnt : 0;
+	for (i = 0; i < QDELAY_BINS - 1 && cnt + sim->qdelay_hist[i] < 0.95 * sim->qdelay_cnt; i++)
+		cnt += sim->qdelay_hist[i];
+	res->qdelay_p95_ms = sim->qdelay_cnt ? (i + 0.5) * QDELAY_BIN_NS / 1e6 : 0;
+	res->events = sim->events;
+}
+
+static int sim_run(const struct scenario *sc, u64 seed, struct result *res)
+{
+	struct sim sim = { .sc = sc, .rng = seed };
+	struct ev ev;
+	u64 bdp;
+	u32 i, j;
+	int err = -ENOMEM;
+
+	sim.flows = calloc(sc->flows, sizeof(*sim.flows));
+	sim.qdelay_hist = calloc(QDELAY_BINS, sizeof(*sim.qdelay_hist));
+	res->flow_tput = calloc(sc->flows, sizeof(*res->flow_tput));
+	if (!sim.flows || !sim.qdelay_hist || !res->flow_tput)
+		goto out;
+	err = flexis_glue_net_init(&sim.net);
+	if (err)
+		goto out;
+	for (i = 0; i < sc->nr_knobs; i++) {
+		err = flexis_glue_sysctl_set(&sim.net, sc->knobs[i].path, sc->knobs[i].name, sc->knobs[i].val);
+		if (err)
+			goto out_net;
+	}
+
+	sim.end_ns = sc->duration * NSEC_PER_SEC;
+	sim.warmup_ns = sc->warmup * NSEC_PER_SEC;
+	sim.bps = sc->capacity * 1e6;
+	sim.svc_ns = max_t(u64, div64_u64((u64)sc->mss * 8 * NSEC_PER_SEC, sim.bps), 1);
+	bdp = sc->rtt[0] * NSEC_PER_MSEC / sim.svc_ns;
+	sim.buffer_ns = (sc->buffer ? sc->buffer : max_t(u64, bdp, 1)) * sim.svc_ns;
+	err = -ENOMEM;
+	for (i = 0; i < sc->flows; i++) {
+		sim.flows[i].rtt_ns = sc->rtt[i % sc->nr_rtt] * NSEC_PER_MSEC;
+		sim.flows[i].start_ns = sc->start[i % sc->nr_start] * NSEC_PER_SEC;
+		if (sim_push(&sim, sim.flows[i].start_ns, EV_START, i, 0, 0))
+			goto out_flows;
+	}
+	if (sc->cross) {
+		sim.cross_gap_ns = sc->mss * 8 * 1e9 / (sc->cross * 1e6);
+		sim.cross_on = true;
+		if (sim_push(&sim, rng_exp(&sim.rng, sim.cross_gap_ns), EV_CROSS, 0, 0, 0))
+			goto out_flows;
+		if (sc->cross_off &&
+		    sim_push(&sim, rng_exp(&sim.rng, sc->cross_on * NSEC_PER_MSEC), EV_CROSS_TOGGLE, 0, 0, 0))
+			goto out_flows;
+	}
+
+	err = 0;
+	while (sim.nr_evs && !err) {
+		sim_pop(&sim, &ev);
+		if (ev.time_ns >= sim.end_ns)
+			break;
+		sim.now_ns = ev.time_ns;
+		sim.events++;
+		err = sim_event(&sim, &ev);
+	}
+	if (!err)
+		sim_result(&sim, res);
+
+out_flows:
+	for (j = 0; j < sc->flows; j++) {
+		if (sim.flows[j].sk.net)
+			flexis_glue_sock_release(&sim.flows[j].sk);
+		free(sim.flows[j].delivered);
+		free(sim.flows[j].txs.buf);
+		free(sim.flows[j].rtx.buf);
+	}
+out_net:
+	flexis_glue_net_exit(&sim.net);
+out:
+	free(sim.heap);
+	free(sim.qdelay_hist);
+	free(sim.flows);
+	return err;
+}
+
+static bool deque_pop(struct deque *dq, u32 *task)
+{
+	bool ret;
+
+	pthread_mutex_lock(&dq->lock);
+	ret = dq->bottom > dq->top;
+	if (ret)
+		*task = dq->tasks[--dq->bottom];
+	pthread_mutex_unlock(&dq->lock);
+	return ret;
+}
+
+static bool deque_steal(struct deque *dq, u32 *task)
+{
+	bool ret;
+
+	pthread_mutex_lock(&dq->lock);
+	ret = dq->bottom > dq->top;
+	if (ret)
+		*task = dq->tasks[dq->top++];
+	pthread_mutex_unlock(&dq->lock);
+	return ret;
+}
+
+// taking the next task of a worker, stealing one from another worker when it has none left
+static bool worker_next(struct worker *w, u32 *task)
+{
+	struct pool *pool = w->pool;
+	int i, start;
+
+	if (deque_pop(&w->dq, task))
+		return true;
+	// tasks are never added, so the pool is done once every deque is found empty
+	start = rng_next(&w->rng) % pool->nr_workers;
+	for (i = 0; i < pool->nr_workers; i++) {
+		if (deque_steal(&pool->workers[(start + i) % pool->nr_workers].dq, task)) {
+			w->steals++;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void print_result(const struct pool *pool, u32 task)
+{
+	const struct scenario *sc = &pool->scenarios[task / pool->runs];
+	const struct result *res = &pool->results[task];
+	u32 i;
+
+	printf("%u %u %llu ", task / pool->runs, task % pool->runs, (unsigned long long)res->seed);
+	if (res->err) {
+		printf("error %d %s\n", res->err, sc->desc);
+		return;
+	}
+	printf("%.3f %.2f %.3f %.3f %.4f %.4f %llu %llu %s", res->tput, res->util, res->qdelay_ms, res->qdelay_p95_ms, res->loss,
+	       res->jain, (unsigned long long)res->decs, (unsigned long long)res->timeouts, sc->desc);
+	for (i = 0; pool->per_flow && i < sc->flows; i++)
+		printf(i ? ":%.3f" : " %.3f", res->flow_tput[i]);
+	printf("\n");
+}
+
+// printing the results that completed the run of results in task order
+static void pool_done(struct pool *pool, u32 task)
+{
+	pthread_mutex_lock(&pool->print_lock);
+	pool->results[task].done = true;
+	for (; pool->next_print < pool->nr_tasks && pool->results[pool->next_print].done; pool->next_print++) {
+		print_result(pool, pool->next_print);
+		free(pool->results[pool->next_print].flow_tput);
+		pool->results[pool->next_print].flow_tput = NULL;
+	}
+	fflush(stdout);
+	pthread_mutex_unlock(&pool->print_lock);
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	struct pool *pool = w->pool;
+	struct result *res;
+	u64 s;
+	u32 task;
+
+	while (worker_next(w, &task)) {
+		res = &pool->results[task];
+		s = pool->seed + task * 0xd1342543de82ef95ULL;
+		res->seed = rng_next(&s);
+		res->err = sim_run(&pool->scenarios[task / pool->runs], res->seed, res);
+		w->events += res->events;
+		pool_done(pool, task);
+	}
+	return NULL;
+}
+
+static int parse_double(const char *s, double *val)
+{
+	char *end;
+
+	*val = strtod(s, &end);
+	return end == s || *end || !isfinite(*val) ? -EINVAL : 0;
+}
+
+// setting a model key of a scenario, returning -ENOENT if key is not one
+static int model_set(struct scenario *sc, const char *key, const char *val)
+{
+	const struct model_key *k;
+	char *copy, *tok, *save;
+	double d;
+	u32 *cnt;
+	size_t i;
+	int err = 0;
+
+	for (i = 0; i < ARRAY_SIZE(model_keys) && strcmp(model_keys[i].name, key); i++)
+		;
+	if (i == ARRAY_SIZE(model_keys))
+		return -ENOENT;
+	k = &model_keys[i];
+	if (k->kind != KEY_LIST) {
+		if (parse_double(val, &d) || d < 0 || (k->kind == KEY_U32 && (d != (u32)d)))
+			return -EINVAL;
+		if (k->kind == KEY_U32)
+			*(u32 *)((char *)sc + k->off) = d;
+		else
+			*(double *)((char *)sc + k->off) = d;
+		return 0;
+	}
+	// a per flow list "v1:v2:..."
+	cnt = (u32 *)((char *)sc + k->cnt_off);
+	*cnt = 0;
+	copy = strdup(val);
+	if (!copy)
+		return -ENOMEM;
+	for (tok = strtok_r(copy, ":", &save); tok && !err; tok = strtok_r(NULL, ":", &save)) {
+		if (*cnt == MAX_LIST || parse_double(tok, &d) || d < 0)
+			err = -EINVAL;
+		else
+			((double *)((char *)sc + k->off))[(*cnt)++] = d;
+	}
+	free(copy);
+	return err || !*cnt ? -EINVAL : 0;
+}
+
+/*
+ * setting a sysctl of a scenario. key is the name of an entry of net/flexis/default or of net/flexis, or
+ * "<dir>/<name>" for net/flexis/<dir>/<name>. The value is checked on probe, a namespace of no scenario
+ */
+static int knob_set(struct scenario *sc, struct net *probe, const char *key, const char *val)
+{
+	struct knob knob = { 0 }, *knobs;
+	const char *slash = strrchr(key, '/');
+	char *end;
+	long cur;
+	u32 i;
+
+	knob.val = strtol(val, &end, 0);
+	if (end == val || *end)
+		return -EINVAL;
+	if (slash) {
+		snprintf(knob.path, sizeof(knob.path), "net/flexis/%.*s", (int)(slash - key), key);
+		snprintf(knob.name, sizeof(knob.name), "%s", slash + 1);
+	} else {
+		snprintf(knob.path, sizeof(knob.path), "net/flexis/default");
+		snprintf(knob.name, sizeof(knob.name), "%s", key);
+		if (flexis_glue_sysctl_get(probe, knob.path, knob.name, &cur))
+			snprintf(knob.path, sizeof(knob.path), "net/flexis");
+	}
+	if (flexis_glue_sysctl_get(probe, knob.path, knob.name, &cur))
+		return -ENOENT;
+	if (flexis_glue_sysctl_set(probe, knob.path, knob.name, knob.val))
+		return -EINVAL;
+	flexis_glue_sysctl_set(probe, knob.path, knob.name, cur);
+
+	for (i = 0; i < sc->nr_knobs; i++) {
+		if (!strcmp(sc->knobs[i].path, knob.path) && !strcmp(sc->knobs[i].name, knob.name)) {
+			sc->knobs[i] = knob;
+			return 0;
+		}
+	}
+	knobs = realloc(sc->knobs, (sc->nr_knobs + 1) * sizeof(*knobs));
+	if (!knobs)
+		return -ENOMEM;
+	sc->knobs = knobs;
+	sc->knobs[sc->nr_knobs++] = knob;
+	return 0;
+}
+
+static int scenario_check(const struct scenario *sc)
+{
+	if (!sc->capacity || !sc->flows || sc->flows > MAX_FLOWS || sc->mss < 64 || sc->mss > 65535)
+		return -EINVAL;
+	if (sc->rtt[0] <= 0 || sc->duration <= sc->warmup || sc->loss > 100)
+		return -EINVAL;
+	return sc->cross_off && !sc->cross_on ? -EINVAL : 0;
+}
+
+// adding a scenario for one value of every assignment, vals[i] being the value of as[i]
+static int scenario_add(struct scenario **scenarios, u32 *nr, struct net *probe, const struct assign *as, const char **vals, u32 nr_as)
+{
+	struct scenario sc = {
+		.capacity = 100, .flows = 2, .rtt = { 40 }, .nr_rtt = 1, .nr_start = 1, .duration = 60, .warmup = 10, .mss = 1500,
+	};
+	struct scenario *tmp;
+	size_t len = 2, off = 0;
+	u32 i;
+	int err;
+
+	for (i = 0; i < nr_as; i++) {
+		err = model_set(&sc, as[i].key, vals[i]);
+		if (err == -ENOENT)
+			err = knob_set(&sc, probe, as[i].key, vals[i]);
+		if (err) {
+			fprintf(stderr, "%s=%s: %s\n", as[i].key, vals[i], err == -ENOENT ? "unknown key" : "invalid value");
+			return err;
+		}
+		len += strlen(as[i].key) + strlen(vals[i]) + 2;
+	}
+	sc.desc = malloc(len);
+	if (!sc.desc)
+		return -ENOMEM;
+	strcpy(sc.desc, "-");
+	for (i = 0; i < nr_as; i++)
+		off += sprintf(sc.desc + off, "%s%s=%s", i ? "," : "", as[i].key, vals[i]);
+	if (scenario_check(&sc)) {
+		fprintf(stderr, "invalid scenario %s\n", sc.desc);
+		return -EINVAL;
+	}
+
+	tmp = realloc(*scenarios, (*nr + 1) * sizeof(**scenarios));
+	if (!tmp)
+		return -ENOMEM;
+	*scenarios = tmp;
+	(*scenarios)[(*nr)++] = sc;
+	return 0;
+}
+
+// adding the scenarios of every combination of the values of the assignments
+static int scenario_expand(struct scenario **scenarios, u32 *nr, struct net *probe, const struct assign *as, u32 nr_as)
+{
+	const char *vals[nr_as + 1];
+	u32 idx[nr_as + 1], i;
+	int err;
+
+	memset(idx, 0, sizeof(idx));
+	for (;;) {
+		for (i = 0; i < nr_as; i++)
+			vals[i] = as[i].vals[idx[i]];
+		err = scenario_add(scenarios, nr, probe, as, vals, nr_as);
+		if (err)
+			return err;
+		for (i = nr_as; i > 0 && ++idx[i - 1] == as[i - 1].nr; i--)
+			idx[i - 1] = 0;
+		if (!i)
+			return 0;
+	}
+}
+
+static void assign_free(struct assign *a)
+{
+	free(a->key);
+	free(a->buf);
+	free(a->vals);
+}
+
+// adding "key=v1,v2,..." to a list of assignments, replacing an earlier assignment of the same key
+static int assign_add(struct assign **as, u32 *nr, const char *tok)
+{
+	const char *eq = strchr(tok, '=');
+	struct assign a = { 0 }, *tmp;
+	char *v, *save;
+	char **vals;
+	u32 i;
+
+	if (!eq || eq == tok)
+		return -EINVAL;
+	a.key = strndup(tok, eq - tok);
+	a.buf = strdup(eq + 1);
+	if (!a.key || !a.buf)
+		goto err;
+	for (v = strtok_r(a.buf, ",", &save); v; v = strtok_r(NULL, ",", &save)) {
+		vals = realloc(a.vals, (a.nr + 1) * sizeof(*vals));
+		if (!vals)
+			goto err;
+		a.vals = vals;
+		a.vals[a.nr++] = v;
+	}
+	if (!a.nr)
+		goto err;
+	for (i = 0; i < *nr && strcmp((*as)[i].key, a.key); i++)
+		;
+	if (i < *nr) {
+		assign_free(&(*as)[i]);
+	} else {
+		tmp = realloc(*as, (*nr + 1) * sizeof(**as));
+		if (!tmp)
+			goto err;
+		*as = tmp;
+		(*nr)++;
+	}
+	(*as)[i] = a;
+	return 0;
+err:
+	assign_free(&a);
+	return -EINVAL;
+}
+
+// adding the assignments of a line, up to a '#'
+static int assign_line(struct assign **as, u32 *nr, char *line)
+{
+	char *tok, *save;
+
+	for (tok = strtok_r(line, " \t\r\n", &save); tok && *tok != '#'; tok = strtok_r(NULL, " \t\r\n", &save)) {
+		if (assign_add(as, nr, tok)) {
+			fprintf(stderr, "invalid assignment %s\n", tok);
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
+/*
+ * reading the scenarios of the lines of path, "-" for stdin, or of the command line when path is NULL. the
+ * assignments of the command line are added to every line and replace those of the same keys. lines without
+ * assignments are skipped
+ */
+static int scenarios_read(struct scenario **scenarios, u32 *nr, const char *path, char **args, int nr_args)
+{
+	struct assign *as = NULL;
+	struct net probe = { 0 };
+	char *line = NULL;
+	size_t len = 0;
+	u32 nr_as = 0, i;
+	FILE *f = NULL;
+	int err, j;
+
+	err = flexis_glue_net_init(&probe);
+	if (err)
+		return err;
+	if (path) {
+		f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+		if (!f) {
+			perror(path);
+			err = -ENOENT;
+			goto out;
+		}
+	}
+	while (!err && (!f || getline(&line, &len, f) >= 0)) {
+		err = f ? assign_line(&as, &nr_as, line) : 0;
+		if (!err && (!f || nr_as)) {
+			for (j = 0; j < nr_args && !err; j++) {
+				err = assign_add(&as, &nr_as, args[j]);
+				if (err)
+					fprintf(stderr, "invalid assignment %s\n", args[j]);
+			}
+			if (!err)
+				err = scenario_expand(scenarios, nr, &probe, as, nr_as);
+		}
+		for (i = 0; i < nr_as; i++)
+			assign_free(&as[i]);
+		nr_as = 0;
+		if (!f)
+			break;
+	}
+	if (f && f != stdin)
+		fclose(f);
+out:
+	free(as);
+	free(line);
+	flexis_glue_net_exit(&probe);
+	return err;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-j threads] [-r runs] [-S seed] [-f scenarios] [-v] [key=value[,value...] ...]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct scenario *scenarios = NULL;
+	struct worker *workers;
+	struct pool pool = { .runs = 1, .seed = 1 };
+	const char *path = NULL;
+	int nr_workers = sysconf(_SC_NPROCESSORS_ONLN), opt, i, err = 0;
+	u64 start, ns, events = 0, steals = 0;
+	u32 nr = 0, t;
+
+	while ((opt = getopt(argc, argv, "j:r:S:f:vh")) != -1) {
+		switch (opt) {
+		case 'j':
+			nr_workers = atoi(optarg);
+			break;
+		case 'r':
+			pool.runs = atoi(optarg);
+			break;
+		case 'S':
+			pool.seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'f':
+			path = optarg;
+			break;
+		case 'v':
+			pool.per_flow = true;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (nr_workers < 1 || pool.runs < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (flexis_glue_init())
+		return 1;
+	// the host wide memory cap would make the scenarios running at the same time depend on each other
+	flexis_glue_sysctl_set(&init_net, "net/flexis", "mem_max", 0);
+	if (scenarios_read(&scenarios, &nr, path, argv + optind, argc - optind))
+		return 1;
+	if (!nr || (u64)nr * pool.runs > UINT_MAX) {
+		fprintf(stderr, "no scenarios\n");
+		return 1;
+	}
+
+	pool.scenarios = scenarios;
+	pool.nr_tasks = nr * pool.runs;
+	pool.nr_workers = nr_workers = min_t(u32, nr_workers, pool.nr_tasks);
+	pool.results = calloc(pool.nr_tasks, sizeof(*pool.results));
+	pool.workers = workers = calloc(nr_workers, sizeof(*workers));
+	if (!pool.results || !workers)
+		return 1;
+	pthread_mutex_init(&pool.print_lock, NULL);
+	// dealing the tasks round robin, so neighbouring scenarios of a sweep start on different workers
+	for (i = 0; i < nr_workers; i++) {
+		workers[i].pool = &pool;
+		workers[i].rng = pool.seed + i;
+		pthread_mutex_init(&workers[i].dq.lock, NULL);
+		workers[i].dq.tasks = malloc((pool.nr_tasks / nr_workers + 1) * sizeof(u32));
+		if (!workers[i].dq.tasks)
+			return 1;
+	}
+	for (t = pool.nr_tasks; t-- > 0;) {
+		struct deque *dq = &workers[t % nr_workers].dq;
+
+		dq->tasks[dq->bottom++] = t;
+	}
+
+	printf("# scenario run seed tput_mbps util_pct qdelay_ms qdelay_p95_ms loss_pct jain decreases timeouts params%s\n",
+	       pool.per_flow ? " flow_tput_mbps" : "");
+	start = now_ns();
+	for (i = 0; i < nr_workers; i++) {
+		if (pthread_create(&workers[i].thread, NULL, worker_run, &workers[i])) {
+			nr_workers = i;
+			break;
+		}
+	}
+	// the tasks of a worker that could not be started are stolen by the others
+	if (!nr_workers)
+		worker_run(&workers[0]);
+	for (i = 0; i < nr_workers; i++)
+		pthread_join(workers[i].thread, NULL);
+	ns = now_ns() - start;
+
+	for (t = 0; t < pool.nr_tasks; t++)
+		err |= pool.results[t].err;
+	for (i = 0; i < pool.nr_workers; i++) {
+		events += workers[i].events;
+		steals += workers[i].steals;
+		free(workers[i].dq.tasks);
+	}
+	fprintf(stderr, "%u scenarios x %u runs, %d workers, %.3f s, %.2f M events/s, %llu steals\n", nr, pool.runs, nr_workers,
+		ns / 1e9, events / (ns / 1e3), (unsigned long long)steals);
+
+	for (t = 0; t < nr; t++) {
+		free(scenarios[t].knobs);
+		free(scenarios[t].desc);
+	}
+	free(scenarios);
+	free(pool.results);
+	free(workers);
+	flexis_glue_exit();
+	return err ? 1 : 0;
+}
@@ -0,0 +1,1059 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs tcp_flexis.c over the TCP flows of a pcap capture and reports what FlexiS would have decided on each flow.
+ *
+ * The capture is memory mapped. Classic pcap files in either byte order with us or ns timestamps are read, with
+ * Ethernet (optionally VLAN tagged), raw IP and Linux cooked (SLL and SLL2) link types, and IPv4 or IPv6.
+ *
+ * Every direction of a connection that sends data is a flow. Its RTT samples are reconstructed at the capture point:
+ * an ACK that acknowledges new data gives the time since the last newly acknowledged segment was sent, unless one
+ * of the newly acknowledged segments was retransmitted (Karn's rule), in which case the TS echo reply is used if
+ * the flow carries timestamps. The capture should therefore be taken near the senders. Every new ACK is delivered
+ * to a FlexiS instance of the flow, which is assumed to be cwnd limited.
+ *
+ * Connections are sharded across worker threads by the hash of their addresses and ports. The main thread scans the
+ * mapping once and hands the offsets of the records of each worker over a bounded queue of batches, so the workers
+ * run while the capture is scanned and the memory used does not grow with the capture. Each worker only parses its
+ * own records and runs in its own network namespace. A SYN with the addresses and ports of a closed connection starts
+ * a new one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "flexis_glue.h"
+
+#define PCAP_MAGIC_US 0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define PCAP_HDR_LEN 24
+#define PCAP_REC_LEN 16
+
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_IPV4 228
+#define LINKTYPE_IPV6 229
+#define LINKTYPE_LINUX_SLL2 276
+
+#define ETH_P_IP 0x0800
+#define ETH_P_IPV6 0x86dd
+#define ETH_P_8021Q 0x8100
+#define ETH_P_8021AD 0x88a8
+
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+#define TCP_ACK 0x10
+
+// the maximum number of unacknowledged segments or timestamps remembered per flow
+#define RING_MAX (1U << 16)
+// the number of record offsets in a batch handed to a worker, and the number of batches queued per worker
+#define BATCH_RECS 4096
+#define QUEUE_BATCHES 8
+
+struct capture {
+	const u8 *data;
+	size_t size;
+	bool swap;
+	bool nsec;
+	u32 linktype;
+};
+
+// a TCP segment as seen by a worker, addresses are in network byte order
+struct pkt {
+	u64 time_us;
+	u8 family;
+	u32 saddr[4];
+	u32 daddr[4];
+	u16 sport;
+	u16 dport;
+	u32 seq;
+	u32 ack;
+	u8 flags;
+	u32 len;
+	bool has_ts;
+	u32 tsval;
+	u32 tsecr;
+};
+
+struct seg {
+	u32 end;
+	bool retrans;
+	u64 time_us;
+};
+
+struct tsent {
+	u32 tsval;
+	u64 time_us;
+};
+
+// a growable ring of T, the capacity is a power of 2
+#define RING(T) struct { T *buf; u32 head; u32 cnt; u32 cap; }
+#define ring_at(r, i) ((r)->buf[((r)->head + (i)) & ((r)->cap - 1)])
+
+// a decision of the FlexiS instance of a flow
+struct event {
+	u64 time_us;
+	bool dec;
+	u32 cwnd;
+	s32 rtt_us;
+};
+
+/*
+ * one direction of a connection
+ * @isn: the first sequence number seen, sequence numbers are relative to it
+ * @snd_nxt: the end of the highest segment sent
+ * @snd_una: the highest acknowledgment received
+ * @segs: the segments sent and not acknowledged yet
+ * @tss: the times the timestamp values were first sent
+ * @sk: the FlexiS instance, created by the first new ACK
+ */
+struct half {
+	bool init;
+	u32 isn;
+	u32 snd_nxt;
+	u32 snd_una;
+	bool fin;
+	RING(struct seg) segs;
+	RING(struct tsent) tss;
+	struct sock *sk;
+	bool pending;
+	u64 t0;
+	u64 pkts;
+	u64 bytes;
+	u64 retrans;
+	u64 samples;
+	u64 ts_samples;
+	u64 first_us;
+	u64 last_us;
+	u32 decs;
+	struct event *events;
+	size_t nr_events;
+	size_t cap_events;
+};
+
+// a connection, endpoint 0 is the one with the lower address and port
+struct conn {
+	u8 family;
+	u32 addr[2][4];
+	u16 port[2];
+	u32 hash;
+	bool closed;
+	struct half half[2];
+};
+
+// the offsets of capture records, in capture order
+struct batch {
+	u32 cnt;
+	size_t offs[BATCH_RECS];
+};
+
+/*
+ * a worker thread and the connections it owns
+ * @queue: the batches of records of its connections. the scan fills batch (head + cnt) % QUEUE_BATCHES and queues it by
+ * incrementing cnt, the worker processes batch head in place and then frees it by moving head
+ * @filling: the batch being filled by the scan, not queued yet, NULL if none
+ * @done: set by the scan once every record is queued
+ * @closed: the closed connections whose addresses and ports were reused, kept for the report
+ */
+struct worker {
+	pthread_t thread;
+	int id;
+	const struct capture *cap;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct batch queue[QUEUE_BATCHES];
+	u32 head;
+	u32 cnt;
+	struct batch *filling;
+	bool done;
+	struct net net;
+	int estimator;
+	struct conn **table;
+	size_t table_cap;
+	size_t nr_conns;
+	struct conn **closed;
+	size_t nr_closed;
+	size_t cap_closed;
+	u64 pkts_own;
+	u64 ns;
+	int err;
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline u16 be16(const u8 *p)
+{
+	return (u16)p[0] << 8 | p[1];
+}
+
+static inline u32 be32(const u8 *p)
+{
+	return (u32)p[0] << 24 | (u32)p[1] << 16 | (u32)p[2] << 8 | p[3];
+}
+
+static inline u32 cap32(const struct capture *cap, const u8 *p)
+{
+	u32 v;
+
+	memcpy(&v, p, sizeof(v));
+	return cap->swap ? __builtin_bswap32(v) : v;
+}
+
+static inline bool seq_after(u32 a, u32 b)
+{
+	return (s32)(a - b) > 0;
+}
+
+static int capture_open(struct capture *cap, const char *path)
+{
+	struct stat st;
+	u32 magic;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(path);
+		return -1;
+	}
+	if (st.st_size < PCAP_HDR_LEN) {
+		fprintf(stderr, "%s: not a pcap file\n", path);
+		close(fd);
+		return -1;
+	}
+	cap->size = st.st_size;
+	cap->data = mmap(NULL, cap->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (cap->data == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+	madvise((void *)cap->data, cap->size, MADV_SEQUENTIAL);
+
+	memcpy(&magic, cap->data, sizeof(magic));
+	cap->swap = magic == __builtin_bswap32(PCAP_MAGIC_US) || magic == __builtin_bswap32(PCAP_MAGIC_NS);
+	if (cap->swap)
+		magic = __builtin_bswap32(magic);
+	if (magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS) {
+		fprintf(stderr, "%s: not a pcap file (pcapng is not supported)\n", path);
+		munmap((void *)cap->data, cap->size);
+		return -1;
+	}
+	cap->nsec = magic == PCAP_MAGIC_NS;
+	cap->linktype = cap32(cap, cap->data + 20) & 0xffff;
+	switch (cap->linktype) {
+	case LINKTYPE_ETHERNET:
+	case LINKTYPE_RAW:
+	case LINKTYPE_LINUX_SLL:
+	case LINKTYPE_IPV4:
+	case LINKTYPE_IPV6:
+	case LINKTYPE_LINUX_SLL2:
+		return 0;
+	default:
+		fprintf(stderr, "%s: unsupported link type %u\n", path, cap->linktype);
+		munmap((void *)cap->data, cap->size);
+		return -1;
+	}
+}
+
+// returning the IP header of a frame and its ethertype, NULL if the frame does not carry IP
+static const u8 *frame_ip(const struct capture *cap, const u8 *p, u32 len, u16 *proto, u32 *ip_len)
+{
+	u32 off;
+
+	switch (cap->linktype) {
+	case LINKTYPE_ETHERNET:
+		if (len < 14)
+			return NULL;
+		*proto = be16(p + 12);
+		off = 14;
+		while ((*proto == ETH_P_8021Q || *proto == ETH_P_8021AD) && len >= off + 4) {
+			*proto = be16(p + off + 2);
+			off += 4;
+		}
+		break;
+	case LINKTYPE_LINUX_SLL:
+		if (len < 16)
+			return NULL;
+		*proto = be16(p + 14);
+		off = 16;
+		break;
+	case LINKTYPE_LINUX_SLL2:
+		if (len < 20)
+			return NULL;
+		*proto = be16(p);
+		off = 20;
+		break;
+	default:
+		if (len < 1)
+			return NULL;
+		*proto = (p[0] >> 4) == 6 ? ETH_P_IPV6 : ETH_P_IP;
+		off = 0;
+		break;
+	}
+	if (off >= len)
+		return NULL;
+	*ip_len = len - off;
+	return p + off;
+}
+
+/*
+ * parsing the addresses and ports of a TCP segment, returning its TCP header or NULL. fragments and IPv6
+ * extension headers are skipped. tcp_len is the length of the segment on the wire, which is more than
+ * the captured bytes when the capture has a snap length
+ */
+static const u8 *parse_ports(const u8 *ip, u32 len, u16 proto, struct pkt *pkt, u32 *tcp_len)
+{
+	u32 hl, tot;
+
+	if (proto == ETH_P_IP) {
+		if (len < 20 || (ip[0] >> 4) != 4 || ip[9] != 6)
+			return NULL;
+		hl = (ip[0] & 0xf) * 4;
+		tot = be16(ip + 2);
+		// skipping all fragments but the first
+		if (be16(ip + 6) & 0x1fff)
+			return NULL;
+		if (hl < 20 || tot < hl + 20 || len < hl + 20)
+			return NULL;
+		pkt->family = AF_INET;
+		memset(pkt->saddr, 0, sizeof(pkt->saddr));
+		memset(pkt->daddr, 0, sizeof(pkt->daddr));
+		memcpy(pkt->saddr, ip + 12, 4);
+		memcpy(pkt->daddr, ip + 16, 4);
+	} else if (proto == ETH_P_IPV6) {
+		if (len < 40 || (ip[0] >> 4) != 6 || ip[6] != 6)
+			return NULL;
+		hl = 40;
+		tot = 40 + be16(ip + 4);
+		if (tot < hl + 20 || len < hl + 20)
+			return NULL;
+		pkt->family = AF_INET6;
+		memcpy(pkt->saddr, ip + 8, 16);
+		memcpy(pkt->daddr, ip + 24, 16);
+	} else {
+		return NULL;
+	}
+	pkt->sport = be16(ip + hl);
+	pkt->dport = be16(ip + hl + 2);
+	*tcp_len = tot - hl;
+	return ip + hl;
+}
+
+// parsing the rest of the TCP header, of which caplen bytes were captured
+static bool parse_tcp(const u8 *tcp, u32 len, u32 caplen, struct pkt *pkt)
+{
+	u32 doff = (tcp[12] >> 4) * 4, i, olen;
+
+	if (doff < 20 || doff > len || doff > caplen)
+		return false;
+	pkt->seq = be32(tcp + 4);
+	pkt->ack = be32(tcp + 8);
+	pkt->flags = tcp[13];
+	pkt->len = len - doff;
+	pkt->has_ts = false;
+	for (i = 20; i < doff;) {
+		if (tcp[i] == 0)
+			break;
+		if (tcp[i] == 1) {
+			i++;
+			continue;
+		}
+		if (i + 1 >= doff)
+			break;
+		olen = tcp[i + 1];
+		if (olen < 2 || i + olen > doff)
+			break;
+		if (tcp[i] == 8 && olen == 10) {
+			pkt->has_ts = true;
+			pkt->tsval = be32(tcp + i + 2);
+			pkt->tsecr = be32(tcp + i + 6);
+		}
+		i += olen;
+	}
+	return true;
+}
+
+// the hash of a connection, the same for both directions
+static u32 conn_hash(const struct pkt *pkt)
+{
+	u32 a = jhash2(pkt->saddr, 4, pkt->sport), b = jhash2(pkt->daddr, 4, pkt->dport);
+
+	return (a ^ b) * 0x9e3779b1;
+}
+
+// returning which endpoint of the connection sent pkt, 0 for the lower address and port
+static int conn_side(const struct pkt *pkt)
+{
+	int c = memcmp(pkt->saddr, pkt->daddr, sizeof(pkt->saddr));
+
+	return c > 0 || (!c && pkt->sport > pkt->dport);
+}
+
+static bool conn_match(const struct conn *conn, const struct pkt *pkt, int side)
+{
+	return conn->family == pkt->family && conn->port[side] == pkt->sport && conn->port[!side] == pkt->dport &&
+	       !memcmp(conn->addr[side], pkt->saddr, sizeof(pkt->saddr)) && !memcmp(conn->addr[!side], pkt->daddr, sizeof(pkt->daddr));
+}
+
+static int table_grow(struct worker *w)
+{
+	size_t cap = w->table_cap ? w->table_cap * 2 : 1024, i, j;
+	struct conn **table = calloc(cap, sizeof(*table));
+
+	if (!table)
+		return -1;
+	for (i = 0; i < w->table_cap; i++) {
+		if (!w->table[i])
+			continue;
+		for (j = w->table[i]->hash & (cap - 1); table[j]; j = (j + 1) & (cap - 1))
+			;
+		table[j] = w->table[i];
+	}
+	free(w->table);
+	w->table = table;
+	w->table_cap = cap;
+	return 0;
+}
+
+// looking up the connection of pkt, creating it if needed
+static struct conn *conn_get(struct worker *w, const struct pkt *pkt, u32 hash, int side)
+{
+	struct conn *conn;
+	size_t i;
+
+	if ((w->nr_conns + 1) * 2 > w->table_cap && table_grow(w))
+		return NULL;
+	for (i = hash & (w->table_cap - 1); (conn = w->table[i]); i = (i + 1) & (w->table_cap - 1)) {
+		if (conn->hash == hash && conn_match(conn, pkt, side))
+			return conn;
+	}
+	conn = calloc(1, sizeof(*conn));
+	if (!conn)
+		return NULL;
+	conn->family = pkt->family;
+	memcpy(conn->addr[side], pkt->saddr, sizeof(pkt->saddr));
+	memcpy(conn->addr[!side], pkt->daddr, sizeof(pkt->daddr));
+	conn->port[side] = pkt->sport;
+	conn->port[!side] = pkt->dport;
+	conn->hash = hash;
+	w->table[i] = conn;
+	w->nr_conns++;
+	return conn;
+}
+
+// replacing a closed connection by a new one with the same addresses and ports
+static struct conn *conn_reopen(struct worker *w, struct conn *old)
+{
+	struct conn *conn, **tmp;
+	size_t i;
+
+	if (w->nr_closed == w->cap_closed) {
+		tmp = realloc(w->closed, (w->cap_closed ? w->cap_closed * 2 : 64) * sizeof(*tmp));
+		if (!tmp)
+			return NULL;
+		w->closed = tmp;
+		w->cap_closed = w->cap_closed ? w->cap_closed * 2 : 64;
+	}
+	conn = calloc(1, sizeof(*conn));
+	if (!conn)
+		return NULL;
+	conn->family = old->family;
+	memcpy(conn->addr, old->addr, sizeof(conn->addr));
+	memcpy(conn->port, old->port, sizeof(conn->port));
+	conn->hash = old->hash;
+	for (i = old->hash & (w->table_cap - 1); w->table[i] != old; i = (i + 1) & (w->table_cap - 1))
+		;
+	w->table[i] = conn;
+	w->closed[w->nr_closed++] = old;
+	return conn;
+}
+
+// making room for one more entry in a ring, dropping the oldest entry when the ring is at RING_MAX
+#define ring_reserve(r) ({ \
+		int ret__ = 0; \
+		if ((r)->cnt == (r)->cap) { \
+			if ((r)->cap == RING_MAX) { \
+				(r)->head++; \
+				(r)->cnt--; \
+			} else { \
+				ret__ = ring_resize((void **)&(r)->buf, &(r)->head, (r)->cnt, &(r)->cap, sizeof(*(r)->buf)); \
+			} \
+		} \
+		ret__; \
+})
+
+static int ring_resize(void **buf, u32 *head, u32 cnt, u32 *cap, size_t size)
+{
+	u32 new_cap = *cap ? *cap * 2 : 16, i;
+	char *new_buf = malloc(new_cap * size);
+
+	if (!new_buf)
+		return -1;
+	for (i = 0; i < cnt; i++)
+		memcpy(new_buf + i * size, (char *)*buf + ((*head + i) & (*cap - 1)) * size, size);
+	free(*buf);
+	*buf = new_buf;
+	*head = 0;
+	*cap = new_cap;
+	return 0;
+}
+
+static void half_event(struct half *h, u64 time_us, bool dec, s32 rtt_us)
+{
+	struct event *events;
+
+	if (h->nr_events == h->cap_events) {
+		h->cap_events = h->cap_events ? h->cap_events * 2 : 8;
+		events = realloc(h->events, h->cap_events * sizeof(*events));
+		if (!events) {
+			h->cap_events = h->nr_events;
+			return;
+		}
+		h->events = events;
+	}
+	h->events[h->nr_events++] = (struct event){ .time_us = time_us, .dec = dec, .cwnd = h->sk->snd_cwnd, .rtt_us = rtt_us };
+}
+
+static void half_release(struct half *h)
+{
+	if (h->sk) {
+		flexis_glue_sock_release(h->sk);
+		free(h->sk);
+		h->sk = NULL;
+	}
+	free(h->segs.buf);
+	free(h->tss.buf);
+	memset(&h->segs, 0, sizeof(h->segs));
+	memset(&h->tss, 0, sizeof(h->tss));
+}
+
+// recording a segment sent by the endpoint of h
+static void half_send(struct half *h, const struct pkt *pkt)
+{
+	u32 seq, end, i;
+	struct seg *seg;
+
+	if (!h->init) {
+		h->init = true;
+		h->isn = pkt->seq;
+		h->snd_nxt = h->snd_una = 0;
+		h->first_us = pkt->time_us;
+	}
+	h->pkts++;
+	h->last_us = pkt->time_us;
+	seq = pkt->seq - h->isn;
+	end = seq + pkt->len + !!(pkt->flags & (TCP_SYN | TCP_FIN));
+	if (end == seq)
+		return;
+	if (pkt->flags & TCP_FIN)
+		h->fin = true;
+
+	if (seq_after(end, h->snd_nxt)) {
+		if (ring_reserve(&h->segs))
+			return;
+		seg = &ring_at(&h->segs, h->segs.cnt);
+		seg->end = end;
+		seg->retrans = seq_after(h->snd_nxt, seq);
+		seg->time_us = pkt->time_us;
+		h->segs.cnt++;
+		h->bytes += end - h->snd_nxt;
+		h->snd_nxt = end;
+	} else {
+		// a retransmission, the segments it covers give no RTT sample
+		h->retrans++;
+		for (i = h->segs.cnt; i--;) {
+			seg = &ring_at(&h->segs, i);
+			if (!seq_after(seg->end, seq))
+				break;
+			seg->retrans = true;
+		}
+	}
+
+	if (pkt->has_ts && (!h->tss.cnt || seq_after(pkt->tsval, ring_at(&h->tss, h->tss.cnt - 1).tsval))) {
+		if (ring_reserve(&h->tss))
+			return;
+		ring_at(&h->tss, h->tss.cnt) = (struct tsent){ .tsval = pkt->tsval, .time_us = pkt->time_us };
+		h->tss.cnt++;
+	}
+}
+
+// the RTT of the TS echo reply of pkt, -1 if the echoed value was not seen
+static s32 half_ts_rtt(struct half *h, const struct pkt *pkt)
+{
+	struct tsent *ts;
+
+	while (h->tss.cnt && seq_after(pkt->tsecr, ring_at(&h->tss, 0).tsval)) {
+		h->tss.head++;
+		h->tss.cnt--;
+	}
+	if (!h->tss.cnt)
+		return -1;
+	ts = &ring_at(&h->tss, 0);
+	return ts->tsval == pkt->tsecr ? (s32)(pkt->time_us - ts->time_us) : -1;
+}
+
+// delivering an ACK received by the endpoint "side" of conn to the FlexiS instance of its half
+static int half_ack(struct worker *w, struct conn *conn, int side, const struct pkt *pkt)
+{
+	struct half *h = &conn->half[side];
+	u32 ack = pkt->ack - h->isn, acked = 0;
+	u64 last_us = 0;
+	bool karn = false;
+	struct seg *seg;
+	s32 rtt = -1;
+
+	if (!seq_after(ack, h->snd_una) || seq_after(ack, h->snd_nxt))
+		return 0;
+	while (h->segs.cnt && !seq_after((seg = &ring_at(&h->segs, 0))->end, ack)) {
+		karn |= seg->retrans;
+		last_us = seg->time_us;
+		h->segs.head++;
+		h->segs.cnt--;
+		acked++;
+	}
+	if (!acked) {
+		// a partial ACK of the oldest segment
+		acked = 1;
+		karn = true;
+	}
+	h->snd_una = ack;
+
+	if (!karn && last_us) {
+		rtt = pkt->time_us - last_us;
+	} else if (pkt->has_ts) {
+		rtt = half_ts_rtt(h, pkt);
+		if (rtt >= 0)
+			h->ts_samples++;
+	}
+	if (rtt >= 0)
+		h->samples++;
+
+	if (!h->sk) {
+		h->sk = calloc(1, sizeof(*h->sk));
+		if (!h->sk)
+			return -1;
+		h->sk->net = &w->net;
+		// the destination address is the key of the group when net.flexis.coupled is set
+		h->sk->sk_family = conn->family;
+		if (conn->family == AF_INET)
+			h->sk->sk_daddr = conn->addr[!side][0];
+		else
+			memcpy(&h->sk->sk_v6_daddr, conn->addr[!side], sizeof(h->sk->sk_v6_daddr));
+		h->sk->snd_cwnd = 10;
+		h->sk->snd_cwnd_clamp = 1U << 20;
+		flexis_glue_sock_init(h->sk);
+	}
+	h->sk->tcp_mstamp = pkt->time_us;
+	h->sk->max_packets_out = h->sk->snd_cwnd;
+	h->sk->snd_nxt = h->snd_nxt;
+	if (rtt >= 0)
+		h->sk->srtt_us = h->sk->srtt_us ? h->sk->srtt_us - (h->sk->srtt_us >> 3) + rtt : (u32)rtt << 3;
+	flexis_glue_ack(h->sk, ack, acked, rtt);
+
+	if (flexis_glue_pending(h->sk) && !h->pending) {
+		h->decs++;
+		half_event(h, pkt->time_us, true, rtt);
+	} else if (flexis_glue_t0(h->sk) && !h->t0) {
+		half_event(h, pkt->time_us, false, rtt);
+	}
+	h->pending = flexis_glue_pending(h->sk);
+	h->t0 = flexis_glue_t0(h->sk);
+	return 0;
+}
+
+static int process(struct worker *w, struct pkt *pkt, u32 hash)
+{
+	int side = conn_side(pkt);
+	struct conn *conn = conn_get(w, pkt, hash, side);
+
+	if (!conn)
+		return -1;
+	if (conn->closed) {
+		// late segments of the closed connection are ignored, a SYN reuses its addresses and ports
+		if (!(pkt->flags & TCP_SYN))
+			return 0;
+		conn = conn_reopen(w, conn);
+		if (!conn)
+			return -1;
+	}
+	half_send(&conn->half[side], pkt);
+	if ((pkt->flags & TCP_ACK) && conn->half[!side].init && half_ack(w, conn, !side, pkt))
+		return -1;
+	if ((pkt->flags & TCP_RST) || (conn->half[0].fin && conn->half[1].fin && conn->half[0].snd_una == conn->half[0].snd_nxt &&
+	    conn->half[1].snd_una == conn->half[1].snd_nxt)) {
+		// the decisions of the connection are complete, its FlexiS instances and rings are freed
+		conn->closed = true;
+		half_release(&conn->half[0]);
+		half_release(&conn->half[1]);
+	}
+	return 0;
+}
+
+/*
+ * the TCP header of the record at off and the hash of its connection, NULL if the record is not TCP.
+ * caplen is the number of captured bytes from the TCP header on
+ */
+static const u8 *record_tcp(const struct capture *cap, size_t off, struct pkt *pkt, u32 *hash, u32 *tcp_len, u32 *caplen)
+{
+	const u8 *ip, *tcp;
+	u32 ip_len;
+	u16 proto;
+
+	ip = frame_ip(cap, cap->data + off + PCAP_REC_LEN, cap32(cap, cap->data + off + 8), &proto, &ip_len);
+	if (!ip)
+		return NULL;
+	tcp = parse_ports(ip, ip_len, proto, pkt, tcp_len);
+	if (!tcp)
+		return NULL;
+	*hash = conn_hash(pkt);
+	*caplen = ip_len - (tcp - ip);
+	return tcp;
+}
+
+// queueing the batch being filled for the worker
+static void queue_flush(struct worker *w)
+{
+	if (!w->filling)
+		return;
+	pthread_mutex_lock(&w->lock);
+	w->cnt++;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+	w->filling = NULL;
+}
+
+// adding a record to the batch being filled for the worker, waiting for a free batch when its queue is full
+static void queue_add(struct worker *w, size_t off)
+{
+	if (!w->filling) {
+		pthread_mutex_lock(&w->lock);
+		while (w->cnt == QUEUE_BATCHES)
+			pthread_cond_wait(&w->cond, &w->lock);
+		w->filling = &w->queue[(w->head + w->cnt) % QUEUE_BATCHES];
+		pthread_mutex_unlock(&w->lock);
+		w->filling->cnt = 0;
+	}
+	w->filling->offs[w->filling->cnt++] = off;
+	if (w->filling->cnt == BATCH_RECS)
+		queue_flush(w);
+}
+
+// the next batch queued for the worker, NULL once the scan is done and every batch is processed
+static struct batch *queue_next(struct worker *w)
+{
+	struct batch *b = NULL;
+
+	pthread_mutex_lock(&w->lock);
+	while (!w->cnt && !w->done)
+		pthread_cond_wait(&w->cond, &w->lock);
+	if (w->cnt)
+		b = &w->queue[w->head];
+	pthread_mutex_unlock(&w->lock);
+	return b;
+}
+
+// freeing the batch returned by queue_next for the scan
+static void queue_release(struct worker *w)
+{
+	pthread_mutex_lock(&w->lock);
+	w->head = (w->head + 1) % QUEUE_BATCHES;
+	w->cnt--;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+}
+
+// handing every TCP record of the capture to the worker owning its connection, returning the number of records
+static u64 capture_scan(const struct capture *cap, struct worker *workers, int nr_workers)
+{
+	struct pkt pkt;
+	size_t off;
+	u64 cnt = 0;
+	u32 incl, hash, tcp_len, caplen;
+	int i;
+
+	for (off = PCAP_HDR_LEN; off + PCAP_REC_LEN <= cap->size; off += PCAP_REC_LEN + incl) {
+		incl = cap32(cap, cap->data + off + 8);
+		if (off + PCAP_REC_LEN + incl > cap->size)
+			break;
+		cnt++;
+		if (record_tcp(cap, off, &pkt, &hash, &tcp_len, &caplen))
+			queue_add(&workers[hash % nr_workers], off);
+	}
+	for (i = 0; i < nr_workers; i++) {
+		queue_flush(&workers[i]);
+		pthread_mutex_lock(&workers[i].lock);
+		workers[i].done = true;
+		pthread_cond_signal(&workers[i].cond);
+		pthread_mutex_unlock(&workers[i].lock);
+	}
+	return cnt;
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	const struct capture *cap = w->cap;
+	const u8 *tcp;
+	struct pkt pkt;
+	struct batch *b;
+	size_t off, i;
+	u32 hash, tcp_len, caplen;
+	u64 start = now_ns();
+	bool ready;
+
+	w->err = flexis_glue_net_init(&w->net);
+	ready = !w->err;
+	if (ready && flexis_glue_sysctl_set(&w->net, "net/flexis/default", "estimator", w->estimator))
+		w->err = -1;
+
+	// after a failure the queue is still drained, so that the scan never waits on this worker
+	while ((b = queue_next(w))) {
+		for (i = 0; !w->err && i < b->cnt; i++) {
+			off = b->offs[i];
+			tcp = record_tcp(cap, off, &pkt, &hash, &tcp_len, &caplen);
+			if (!parse_tcp(tcp, tcp_len, caplen, &pkt))
+				continue;
+			w->pkts_own++;
+			pkt.time_us = (u64)cap32(cap, cap->data + off) * USEC_PER_SEC +
+				      (cap->nsec ? cap32(cap, cap->data + off + 4) / NSEC_PER_USEC : cap32(cap, cap->data + off + 4));
+			if (process(w, &pkt, hash))
+				w->err = -ENOMEM;
+		}
+		queue_release(w);
+	}
+
+	for (i = 0; i < w->table_cap; i++) {
+		if (w->table[i]) {
+			half_release(&w->table[i]->half[0]);
+			half_release(&w->table[i]->half[1]);
+		}
+	}
+	if (ready)
+		flexis_glue_net_exit(&w->net);
+	w->ns = now_ns() - start;
+	return NULL;
+}
+
+static void print_addr(u8 family, const u32 *addr, u16 port)
+{
+	const u8 *a = (const u8 *)addr;
+	int i;
+
+	if (family == AF_INET) {
+		printf("%u.%u.%u.%u:%u", a[0], a[1], a[2], a[3], port);
+		return;
+	}
+	printf("[");
+	for (i = 0; i < 16; i += 2)
+		printf(i ? ":%x" : "%x", be16(a + i));
+	printf("]:%u", port);
+}
+
+struct flow {
+	const struct conn *conn;
+	int side;
+};
+
+static int flow_cmp(const void *a, const void *b)
+{
+	const struct flow *fa = a, *fb = b;
+	u64 ta = fa->conn->half[fa->side].first_us, tb = fb->conn->half[fb->side].first_us;
+
+	if (ta != tb)
+		return ta < tb ? -1 : 1;
+	if (fa->conn->hash != fb->conn->hash)
+		return fa->conn->hash < fb->conn->hash ? -1 : 1;
+	return fa->side - fb->side;
+}
+
+// adding the flows of conn that had RTT samples
+static int flows_add(struct flow **flows, size_t *cnt, size_t *cap, const struct conn *conn)
+{
+	struct flow *tmp;
+	int s;
+
+	for (s = 0; s < 2; s++) {
+		if (!conn->half[s].samples)
+			continue;
+		if (*cnt == *cap) {
+			tmp = realloc(*flows, (*cap ? *cap * 2 : 1024) * sizeof(*tmp));
+			if (!tmp)
+				return -1;
+			*flows = tmp;
+			*cap = *cap ? *cap * 2 : 1024;
+		}
+		(*flows)[(*cnt)++] = (struct flow){ .conn = conn, .side = s };
+	}
+	return 0;
+}
+
+// printing the flows that had RTT samples in the order of their first packet
+static void report(struct worker *workers, int nr_workers, bool timelines, u64 *nr_flows, u64 *samples, u64 *decs)
+{
+	struct flow *flows = NULL;
+	size_t cnt = 0, cap = 0, i, j;
+	const struct half *h;
+	int k;
+
+	for (k = 0; k < nr_workers; k++) {
+		for (i = 0; i < workers[k].table_cap; i++) {
+			if (workers[k].table[i] && flows_add(&flows, &cnt, &cap, workers[k].table[i]))
+				goto out;
+		}
+		for (i = 0; i < workers[k].nr_closed; i++) {
+			if (flows_add(&flows, &cnt, &cap, workers[k].closed[i]))
+				goto out;
+		}
+	}
+	qsort(flows, cnt, sizeof(*flows), flow_cmp);
+
+	for (i = 0; i < cnt; i++) {
+		h = &flows[i].conn->half[flows[i].side];
+		*samples += h->samples;
+		*decs += h->decs;
+		if (!timelines)
+			continue;
+		printf("flow ");
+		print_addr(flows[i].conn->family, flows[i].conn->addr[flows[i].side], flows[i].conn->port[flows[i].side]);
+		printf(" > ");
+		print_addr(flows[i].conn->family, flows[i].conn->addr[!flows[i].side], flows[i].conn->port[!flows[i].side]);
+		printf(" start %.6f dur %.3f s  %llu pkts %llu bytes %llu retrans  %llu rtt samples (%llu ts)  %u decreases\n",
+		       h->first_us / 1e6, (h->last_us - h->first_us) / 1e6, (unsigned long long)h->pkts, (unsigned long long)h->bytes,
+		       (unsigned long long)h->retrans, (unsigned long long)h->samples, (unsigned long long)h->ts_samples, h->decs);
+		for (j = 0; j < h->nr_events; j++) {
+			printf("  %.6f %s cwnd %u rtt %.3f ms\n", h->events[j].time_us / 1e6, h->events[j].dec ? "dec" : "inc",
+			       h->events[j].cwnd, h->events[j].rtt_us / 1e3);
+		}
+	}
+out:
+	*nr_flows = cnt;
+	free(flows);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-j threads] [-e estimator] [-s] capture.pcap\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct capture cap;
+	struct worker *workers;
+	int nr_workers = sysconf(_SC_NPROCESSORS_ONLN), estimator = 0, opt, i;
+	bool timelines = true;
+	u64 pkts, own = 0, flows = 0, samples = 0, decs = 0, start, ns;
+	size_t j;
+
+	while ((opt = getopt(argc, argv, "j:e:sh")) != -1) {
+		switch (opt) {
+		case 'j':
+			nr_workers = atoi(optarg);
+			break;
+		case 'e':
+			estimator = atoi(optarg);
+			break;
+		case 's':
+			timelines = false;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (optind != argc - 1 || nr_workers < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (capture_open(&cap, argv[optind]))
+		return 1;
+	if (flexis_glue_init())
+		return 1;
+	if (flexis_glue_sysctl_set(&init_net, "net/flexis/default", "estimator", estimator)) {
+		fprintf(stderr, "invalid estimator %d\n", estimator);
+		return 1;
+	}
+	// the host wide memory cap would make the flows of a capture depend on how many others are active at the same time
+	flexis_glue_sysctl_set(&init_net, "net/flexis", "mem_max", 0);
+
+	workers = calloc(nr_workers, sizeof(*workers));
+	if (!workers)
+		return 1;
+	start = now_ns();
+	for (i = 0; i < nr_workers; i++) {
+		workers[i].id = i;
+		workers[i].cap = &cap;
+		workers[i].estimator = estimator;
+		pthread_mutex_init(&workers[i].lock, NULL);
+		pthread_cond_init(&workers[i].cond, NULL);
+		if (pthread_create(&workers[i].thread, NULL, worker_run, &workers[i])) {
+			nr_workers = i;
+			break;
+		}
+	}
+	if (!nr_workers) {
+		fprintf(stderr, "no worker thread could be started\n");
+		return 1;
+	}
+	// the records are sharded over the workers actually started
+	pkts = capture_scan(&cap, workers, nr_workers);
+	for (i = 0; i < nr_workers; i++)
+		pthread_join(workers[i].thread, NULL);
+	ns = now_ns() - start;
+
+	for (i = 0; i < nr_workers; i++) {
+		if (workers[i].err) {
+			fprintf(stderr, "worker %d failed: %d\n", i, workers[i].err);
+			return 1;
+		}
+		own += workers[i].pkts_own;
+	}
+
+	report(workers, nr_workers, timelines, &flows, &samples, &decs);
+	printf("%llu packets, %llu tcp, %llu flows, %llu rtt samples, %llu decreases\n", (unsigned long long)pkts,
+	       (unsigned long long)own, (unsigned long long)flows, (unsigned long long)samples, (unsigned long long)decs);
+	printf("%d workers, %.3f s, %.2f Mpkt/s, %.2f Mpkt/s per worker\n", nr_workers, ns / 1e9, pkts / (ns / 1e3),
+	       pkts / (ns / 1e3) / nr_workers);
+
+	for (i = 0; i < nr_workers; i++) {
+		for (j = 0; j < workers[i].table_cap; j++) {
+			if (workers[i].table[j]) {
+				free(workers[i].table[j]->half[0].events);
+				free(workers[i].table[j]->half[1].events);
+				free(workers[i].table[j]);
+			}
+		}
+		for (j = 0; j < workers[i].nr_closed; j++) {
+			free(workers[i].closed[j]->half[0].events);
+			free(workers[i].closed[j]->half[1].events);
+			free(workers[i].closed[j]);
+		}
+		free(workers[i].table);
+		free(workers[i].closed);
+		pthread_mutex_destroy(&workers[i].lock);
+		pthread_cond_destroy(&workers[i].cond);
+	}
+	free(workers);
+	flexis_glue_exit();
+	munmap((void *)cap.data, cap.size);
+	return 0;
+}
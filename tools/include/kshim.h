@@ -0,0 +1,695 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A minimal userspace stand-in for the kernel interfaces used by tcp_flexis.c, so that the module source
+ * can be compiled unchanged into the userspace tools. Only what tcp_flexis.c touches is provided.
+ */
+#ifndef KSHIM_H
+#define KSHIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <pthread.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
+
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+#define LINUX_VERSION_CODE KERNEL_VERSION(6, 10, 0)
+
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#define __read_mostly
+#define __init
+#define __exit
+#define __net_init
+#define __net_exit
+#define __always_unused __attribute__((unused))
+
+#define BUILD_BUG_ON(cond) _Static_assert(!(cond), #cond)
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+
+#define module_param(name, type, perm)
+
+struct kernel_param;
+
+struct kernel_param_ops {
+	int (*set)(const char *val, const struct kernel_param *kp);
+	int (*get)(char *buffer, const struct kernel_param *kp);
+};
+
+struct kernel_param {
+	const char *name;
+	const struct kernel_param_ops *ops;
+	void *arg;
+};
+
+// the parameters keep their ops, so that a tool can write them as sysfs would
+#define module_param_cb(name, ops, arg, perm) \
+	static const struct kernel_param __param_##name __attribute__((unused)) = { #name, ops, arg }
+#define kernel_param_lock(mod) do { } while (0)
+#define kernel_param_unlock(mod) do { } while (0)
+
+static inline int param_get_int(char *buffer, const struct kernel_param *kp)
+{
+	return sprintf(buffer, "%i\n", *(int *)kp->arg);
+}
+
+static inline int kstrtoint(const char *s, unsigned int base, int *res)
+{
+	char *end;
+	long v;
+
+	errno = 0;
+	v = strtol(s, &end, base);
+	if (end == s || (*end && *end != '\n') || errno || v < INT_MIN || v > INT_MAX) {
+		return -EINVAL;
+	}
+	*res = v;
+	return 0;
+}
+#define MODULE_AUTHOR(x)
+#define MODULE_LICENSE(x)
+#define MODULE_DESCRIPTION(x)
+#define THIS_MODULE NULL
+#define module_init(fn) int kshim_module_init(void) { return fn(); }
+#define module_exit(fn) void kshim_module_exit(void) { fn(); }
+
+#define READ_ONCE(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define WRITE_ONCE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#define smp_load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define cmpxchg(p, o, n) ({ typeof(*(p)) o__ = (o); __atomic_compare_exchange_n((p), &o__, (n), false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); o__; })
+#define xchg(p, v) __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define smp_mb() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+typedef struct {
+	int counter;
+} atomic_t;
+
+#define atomic_read(v) __atomic_load_n(&(v)->counter, __ATOMIC_RELAXED)
+#define atomic_add(i, v) __atomic_fetch_add(&(v)->counter, (i), __ATOMIC_RELAXED)
+#define atomic_sub(i, v) __atomic_fetch_sub(&(v)->counter, (i), __ATOMIC_RELAXED)
+
+typedef struct {
+	long counter;
+} atomic_long_t;
+
+#define ATOMIC_LONG_INIT(i) { (i) }
+#define atomic_long_read(v) __atomic_load_n(&(v)->counter, __ATOMIC_RELAXED)
+#define atomic_long_set(v, i) __atomic_store_n(&(v)->counter, (i), __ATOMIC_RELAXED)
+#define atomic_long_add(i, v) __atomic_fetch_add(&(v)->counter, (i), __ATOMIC_RELAXED)
+#define atomic_long_sub(i, v) __atomic_fetch_sub(&(v)->counter, (i), __ATOMIC_RELAXED)
+#define atomic_long_inc(v) atomic_long_add(1, v)
+#define atomic_long_dec(v) atomic_long_sub(1, v)
+
+/////////////// hrtimer ///////////////
+
+/*
+ * a timer that never fires on its own. the tools run the function of a started timer through the glue,
+ * which plays the softirq in the same thread as the ACKs
+ */
+typedef s64 ktime_t;
+
+#define ns_to_ktime(ns) ((ktime_t)(ns))
+
+enum hrtimer_restart {
+	HRTIMER_NORESTART,
+	HRTIMER_RESTART,
+};
+
+enum hrtimer_mode {
+	HRTIMER_MODE_REL_PINNED_SOFT,
+};
+
+struct hrtimer {
+	enum hrtimer_restart (*function)(struct hrtimer *timer);
+	bool queued;
+	ktime_t delay;
+	u64 expires_us;
+};
+
+static inline void hrtimer_init(struct hrtimer *timer, int clock, enum hrtimer_mode mode)
+{
+	(void)clock;
+	(void)mode;
+	memset(timer, 0, sizeof(*timer));
+}
+
+static inline void hrtimer_start(struct hrtimer *timer, ktime_t delay, enum hrtimer_mode mode)
+{
+	(void)mode;
+	timer->queued = true;
+	timer->delay = delay;
+}
+
+static inline int hrtimer_cancel(struct hrtimer *timer)
+{
+	bool queued = timer->queued;
+
+	timer->queued = false;
+	timer->expires_us = 0;
+	return queued;
+}
+
+/////////////// win_minmax ///////////////
+
+// the inline part of include/linux/win_minmax.h: the best, 2nd best and 3rd best samples of the window. the updates of
+// lib/win_minmax.c are not provided, minmax_running_min is not exported to modules
+struct minmax_sample {
+	u32 t;
+	u32 v;
+};
+
+struct minmax {
+	struct minmax_sample s[3];
+};
+
+static inline u32 minmax_get(const struct minmax *m)
+{
+	return m->s[0].v;
+}
+
+static inline u32 minmax_reset(struct minmax *m, u32 t, u32 meas)
+{
+	struct minmax_sample val = { .t = t, .v = meas };
+
+	m->s[2] = m->s[1] = m->s[0] = val;
+	return m->s[0].v;
+}
+
+/////////////// memory ///////////////
+
+typedef unsigned int gfp_t;
+#define GFP_KERNEL 0U
+#define GFP_ATOMIC 1U
+#define __GFP_NOWARN 2U
+
+static inline void *kzalloc(size_t size, gfp_t flags)
+{
+	(void)flags;
+	return calloc(1, size);
+}
+
+static inline void *kmemdup(const void *src, size_t len, gfp_t flags)
+{
+	void *p = malloc(len);
+
+	(void)flags;
+	if (p)
+		memcpy(p, src, len);
+	return p;
+}
+
+static inline void kfree(const void *p)
+{
+	free((void *)p);
+}
+
+/////////////// arithmetic ///////////////
+
+#define min(a, b) ({ typeof(a) a__ = (a); typeof(b) b__ = (b); a__ < b__ ? a__ : b__; })
+#define max(a, b) ({ typeof(a) a__ = (a); typeof(b) b__ = (b); a__ > b__ ? a__ : b__; })
+#define min_t(t, a, b) ({ t a__ = (a); t b__ = (b); a__ < b__ ? a__ : b__; })
+#define max_t(t, a, b) ({ t a__ = (a); t b__ = (b); a__ > b__ ? a__ : b__; })
+
+#define USEC_PER_MSEC 1000L
+#define USEC_PER_SEC 1000000L
+#define NSEC_PER_USEC 1000L
+#define NSEC_PER_MSEC 1000000L
+#define NSEC_PER_SEC 1000000000L
+
+static inline u64 div_u64_rem(u64 dividend, u32 divisor, u32 *remainder)
+{
+	*remainder = dividend % divisor;
+	return dividend / divisor;
+}
+
+static inline u64 div_u64(u64 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline u64 div64_u64(u64 dividend, u64 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline u64 div64_u64_rem(u64 dividend, u64 divisor, u64 *remainder)
+{
+	*remainder = dividend % divisor;
+	return dividend / divisor;
+}
+
+static inline s64 div64_s64(s64 dividend, s64 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline u64 int_pow(u64 base, unsigned int exp)
+{
+	u64 result = 1;
+
+	while (exp) {
+		if (exp & 1)
+			result *= base;
+		exp >>= 1;
+		base *= base;
+	}
+	return result;
+}
+
+static inline unsigned long __ffs(unsigned long word)
+{
+	return __builtin_ctzl(word);
+}
+
+/////////////// lists ///////////////
+
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+#define container_of(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+static inline void __list_add(struct list_head *new, struct list_head *prev, struct list_head *next)
+{
+	next->prev = new;
+	new->next = next;
+	new->prev = prev;
+	prev->next = new;
+}
+
+static inline void list_add(struct list_head *new, struct list_head *head)
+{
+	__list_add(new, head, head->next);
+}
+
+static inline void list_add_tail(struct list_head *new, struct list_head *head)
+{
+	__list_add(new, head->prev, head);
+}
+
+static inline void list_del(struct list_head *entry)
+{
+	entry->next->prev = entry->prev;
+	entry->prev->next = entry->next;
+	entry->next = NULL;
+	entry->prev = NULL;
+}
+
+static inline int list_empty(const struct list_head *head)
+{
+	return head->next == head;
+}
+
+static inline void list_splice_tail(struct list_head *list, struct list_head *head)
+{
+	struct list_head *first = list->next, *last = list->prev, *at = head->prev;
+
+	if (list_empty(list))
+		return;
+	first->prev = at;
+	at->next = first;
+	last->next = head;
+	head->prev = last;
+}
+
+static inline int list_is_last(const struct list_head *list, const struct list_head *head)
+{
+	return list->next == head;
+}
+
+static inline void list_replace_init(struct list_head *old, struct list_head *new)
+{
+	if (list_empty(old)) {
+		INIT_LIST_HEAD(new);
+		return;
+	}
+	new->next = old->next;
+	new->next->prev = new;
+	new->prev = old->prev;
+	new->prev->next = new;
+	INIT_LIST_HEAD(old);
+}
+
+typedef int (*list_cmp_func_t)(void *priv, const struct list_head *a, const struct list_head *b);
+
+// a stable bottom-up merge sort over the next links, the prev links are rebuilt at the end
+static inline void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
+{
+	struct list_head *list, *tail, *p, *q, *e;
+	size_t insize = 1, nmerges, psize, qsize;
+
+	if (list_empty(head))
+		return;
+	list = head->next;
+	head->prev->next = NULL;
+	for (;;) {
+		p = list;
+		list = tail = NULL;
+		nmerges = 0;
+		while (p) {
+			nmerges++;
+			for (q = p, psize = 0; q && psize < insize; psize++)
+				q = q->next;
+			qsize = insize;
+			while (psize || (qsize && q)) {
+				if (!psize || (qsize && q && cmp(priv, p, q) > 0)) {
+					e = q;
+					q = q->next;
+					qsize--;
+				} else {
+					e = p;
+					p = p->next;
+					psize--;
+				}
+				if (tail)
+					tail->next = e;
+				else
+					list = e;
+				tail = e;
+			}
+			p = q;
+		}
+		tail->next = NULL;
+		if (nmerges <= 1)
+			break;
+		insize *= 2;
+	}
+	for (p = head, e = list; e; p = e, e = e->next) {
+		e->prev = p;
+		p->next = e;
+	}
+	p->next = head;
+	head->prev = p;
+}
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+#define list_first_entry(ptr, type, member) list_entry((ptr)->next, type, member)
+#define list_last_entry(ptr, type, member) list_entry((ptr)->prev, type, member)
+#define list_next_entry(pos, member) list_entry((pos)->member.next, typeof(*(pos)), member)
+#define list_entry_is_head(pos, head, member) (&pos->member == (head))
+#define list_for_each(pos, head) for (pos = (head)->next; pos != (head); pos = pos->next)
+#define list_for_each_entry(pos, head, member) \
+	for (pos = list_first_entry(head, typeof(*pos), member); !list_entry_is_head(pos, head, member); \
+	     pos = list_next_entry(pos, member))
+#define list_for_each_entry_from(pos, head, member) \
+	for (; !list_entry_is_head(pos, head, member); pos = list_next_entry(pos, member))
+#define list_for_each_entry_safe(pos, n, head, member) \
+	for (pos = list_first_entry(head, typeof(*pos), member), n = list_next_entry(pos, member); \
+	     !list_entry_is_head(pos, head, member); pos = n, n = list_next_entry(n, member))
+
+/////////////// hash tables ///////////////
+
+struct hlist_node {
+	struct hlist_node *next, **pprev;
+};
+
+struct hlist_head {
+	struct hlist_node *first;
+};
+
+#define DEFINE_HASHTABLE(name, bits) struct hlist_head name[1 << (bits)]
+#define HASH_SIZE(name) ARRAY_SIZE(name)
+
+static inline void hlist_add_head(struct hlist_node *n, struct hlist_head *h)
+{
+	n->next = h->first;
+	if (h->first)
+		h->first->pprev = &n->next;
+	h->first = n;
+	n->pprev = &h->first;
+}
+
+static inline void hash_del(struct hlist_node *n)
+{
+	*n->pprev = n->next;
+	if (n->next)
+		n->next->pprev = n->pprev;
+	n->next = NULL;
+	n->pprev = NULL;
+}
+
+#define hash_add(table, node, key) hlist_add_head(node, &table[(key) % HASH_SIZE(table)])
+#define hlist_entry_safe(ptr, type, member) ({ typeof(ptr) p__ = (ptr); p__ ? container_of(p__, type, member) : NULL; })
+#define hash_for_each_possible(table, obj, member, key) \
+	for (obj = hlist_entry_safe(table[(key) % HASH_SIZE(table)].first, typeof(*(obj)), member); obj; \
+	     obj = hlist_entry_safe((obj)->member.next, typeof(*(obj)), member))
+
+static inline u32 jhash2(const u32 *k, u32 length, u32 initval)
+{
+	u32 h = initval ^ 0x9e3779b9;
+
+	while (length--) {
+		h ^= *k++;
+		h *= 0x85ebca6b;
+		h ^= h >> 13;
+	}
+	return h;
+}
+
+/////////////// locks ///////////////
+
+typedef pthread_mutex_t spinlock_t;
+
+#define DEFINE_SPINLOCK(name) spinlock_t name = PTHREAD_MUTEX_INITIALIZER
+#define spin_lock_init(l) pthread_mutex_init((l), NULL)
+#define spin_lock_bh(l) pthread_mutex_lock(l)
+#define spin_unlock_bh(l) pthread_mutex_unlock(l)
+#define spin_lock(l) pthread_mutex_lock(l)
+#define spin_unlock(l) pthread_mutex_unlock(l)
+
+/////////////// sysctl and network namespaces ///////////////
+
+struct ctl_table {
+	const char *procname;
+	void *data;
+	int maxlen;
+	unsigned short mode;
+	void *proc_handler;
+	void *extra1;
+	void *extra2;
+};
+
+struct ctl_table_header {
+	struct ctl_table *ctl_table_arg;
+	const char *path;
+	size_t size;
+};
+
+#define proc_dointvec ((void *)1)
+#define proc_dointvec_minmax ((void *)2)
+#define proc_douintvec ((void *)3)
+#define proc_doulongvec_minmax ((void *)4)
+
+struct net;
+
+static inline struct ctl_table_header *register_net_sysctl_sz(struct net *net, const char *path, struct ctl_table *table, size_t size)
+{
+	struct ctl_table_header *hdr = calloc(1, sizeof(*hdr));
+
+	(void)net;
+	if (hdr) {
+		hdr->ctl_table_arg = table;
+		hdr->path = path;
+		hdr->size = size;
+	}
+	return hdr;
+}
+
+static inline void unregister_net_sysctl_table(struct ctl_table_header *hdr)
+{
+	free(hdr);
+}
+
+struct netns_ipv4 {
+	int sysctl_tcp_pacing_ss_ratio;
+	int sysctl_tcp_pacing_ca_ratio;
+};
+
+/*
+ * a network namespace. each userspace scenario owns one, so the per namespace state of
+ * tcp_flexis.c is never shared between threads
+ */
+struct net {
+	struct netns_ipv4 ipv4;
+	void *gen;
+};
+
+struct pernet_operations {
+	int (*init)(struct net *net);
+	void (*exit)(struct net *net);
+	unsigned int *id;
+	size_t size;
+};
+
+extern struct pernet_operations *kshim_pernet_ops;
+extern struct net init_net;
+
+static inline int register_pernet_subsys(struct pernet_operations *ops)
+{
+	kshim_pernet_ops = ops;
+	return 0;
+}
+
+static inline void unregister_pernet_subsys(struct pernet_operations *ops)
+{
+	(void)ops;
+	kshim_pernet_ops = NULL;
+}
+
+static inline void *net_generic(const struct net *net, unsigned int id)
+{
+	(void)id;
+	return net->gen;
+}
+
+static inline bool net_eq(const struct net *a, const struct net *b)
+{
+	return a == b;
+}
+
+static inline u32 net_hash_mix(const struct net *net)
+{
+	return (u32)((uintptr_t)net >> 6);
+}
+
+/////////////// sockets ///////////////
+
+#define IS_ENABLED(option) KSHIM_##option
+#define KSHIM_CONFIG_IPV6 1
+
+#define AF_INET 2
+#define AF_INET6 10
+
+struct in6_addr {
+	union {
+		u8 s6_addr[16];
+		u32 s6_addr32[4];
+	};
+};
+
+static inline bool ipv6_addr_v4mapped(const struct in6_addr *a)
+{
+	return !a->s6_addr32[0] && !a->s6_addr32[1] && a->s6_addr32[2] == __builtin_bswap32(0x0000ffff);
+}
+
+#define ICSK_CA_PRIV_SIZE (13 * sizeof(u64))
+
+enum sk_pacing {
+	SK_PACING_NONE,
+	SK_PACING_NEEDED,
+	SK_PACING_FQ,
+};
+
+enum tcp_ca_event {
+	CA_EVENT_TX_START,
+	CA_EVENT_CWND_RESTART,
+	CA_EVENT_COMPLETE_CWR,
+	CA_EVENT_LOSS,
+	CA_EVENT_ECN_NO_CE,
+	CA_EVENT_ECN_IS_CE,
+};
+
+enum tcp_ca_ack_event_flags {
+	CA_ACK_SLOWPATH = (1 << 0),
+	CA_ACK_WIN_UPDATE = (1 << 1),
+	CA_ACK_ECE = (1 << 2),
+};
+
+struct ack_sample {
+	u32 pkts_acked;
+	s32 rtt_us;
+	u32 in_flight;
+};
+
+/*
+ * a flattened socket holding the tcp_sock and inet_connection_sock fields read by tcp_flexis.c
+ */
+struct sock {
+	struct net *net;
+	u32 sk_mark;
+	unsigned short sk_family;
+	u32 sk_daddr;
+	struct in6_addr sk_v6_daddr;
+	unsigned long sk_pacing_status;
+	// tcp_sock
+	u64 tcp_mstamp;
+	u32 snd_cwnd;
+	u32 snd_cwnd_clamp;
+	u32 snd_ssthresh;
+	u32 prior_cwnd;
+	u32 srtt_us;
+	u32 max_packets_out;
+	u32 snd_nxt;
+	// inet_connection_sock
+	u64 icsk_ca_priv[ICSK_CA_PRIV_SIZE / sizeof(u64)];
+};
+
+#define tcp_sock sock
+#define tcp_sk(sk) (sk)
+
+static inline void *inet_csk_ca(const struct sock *sk)
+{
+	return (void *)sk->icsk_ca_priv;
+}
+
+static inline struct net *sock_net(const struct sock *sk)
+{
+	return sk->net;
+}
+
+struct tcp_congestion_ops {
+	void (*init)(struct sock *sk);
+	void (*release)(struct sock *sk);
+	u32 (*ssthresh)(struct sock *sk);
+	void (*cong_avoid)(struct sock *sk, u32 ack, u32 acked);
+	void (*cwnd_event)(struct sock *sk, enum tcp_ca_event ev);
+	void (*in_ack_event)(struct sock *sk, u32 flags);
+	void (*pkts_acked)(struct sock *sk, const struct ack_sample *sample);
+	u32 (*undo_cwnd)(struct sock *sk);
+	void *owner;
+	const char *name;
+};
+
+extern struct tcp_congestion_ops *kshim_ca_ops;
+
+static inline int tcp_register_congestion_control(struct tcp_congestion_ops *ops)
+{
+	kshim_ca_ops = ops;
+	return 0;
+}
+
+static inline void tcp_unregister_congestion_control(struct tcp_congestion_ops *ops)
+{
+	(void)ops;
+	kshim_ca_ops = NULL;
+}
+
+#endif